@@ -29,6 +29,28 @@
 #define MAX_DIRS 128
 /* Maximum length of inner char buffers - used for storing the pattern and directories */
 #define BUFFER_SIZE 4096
+/* Default number of directory opens each thread keeps in flight with the io_uring engine */
+#define DEFAULT_IO_DEPTH 32
+/* Default number of queued directories past which the hybrid traversal goes depth-first */
+#define DEFAULT_FRONTIER_LIMIT 100000
+/* Default number of sub-directories each thread keeps to crawl itself */
+#define DEFAULT_INLINE_LIMIT 16
+/* Max number of sub-directories each thread may keep to crawl itself */
+#define MAX_INLINE_LIMIT 1024
+/* Default number of entries read from a directory before idle threads are asked to help */
+#define DEFAULT_SPLIT_AFTER 16384
+/* Max number of threads tuned per available CPU with '-X auto' */
+#define AUTO_THREADS_SCALE 4
+/* Max number of threads tuned with '-X auto' */
+#define AUTO_THREADS_MAX 64
+/* Milliseconds a thread may be stuck before another is let through in its place, with --stall-after */
+#define DEFAULT_STALL_AFTER 1000L
+/* Max number of threads let through in place of stuck ones */
+#define DEFAULT_STALL_THREADS 4
+/* Maximum number of devices limits can be set on */
+#define MAX_LIMITS 16
+/* Device limit standing for limits detected from each device's type */
+#define DEVICE_LIMIT_AUTO (-1)
 /* Fetches the bit at position 'i' inside the integer 'x' */
 #define GET_BIT(x,i)  ((x >> i) & 1)
 
@@ -39,21 +61,59 @@ typedef enum prog_flags {
     IGNORE_CASE         = 3,    /* Flag to enable case-insensitive searches */
     QUIET               = 4,    /* Flag to disable all logs and results */
     REVERSE             = 5,    /* Flag to enable reverse ordering when displaying results */
-    NO_WARN             = 6     /* Flag to enable warning messages */
+    NO_WARN             = 6,    /* Flag to enable warning messages */
+    FOLLOW_LINKS        = 7,    /* Flag to follow symbolic links */
+    ONE_FILE_SYSTEM     = 8,    /* Flag to stay on the filesystems of the search paths */
+    DEDUP_MOUNTS        = 9,    /* Flag to enter each mounted subtree only once */
+    INODE_ORDER         = 10,   /* Flag to queue the sub-directories of each directory in inode order */
+    SHOW_STATS          = 11,   /* Flag to print crawl statistics once the crawl is done */
+    PIN_THREADS         = 12    /* Flag to pin each thread to a CPU, node by node */
 } ProgFlags;
 
+typedef enum crawl_engine {
+    ENGINE_SYNC         = 0,    /* Threads open and read each directory with blocking calls */
+    ENGINE_URING        = 1     /* Threads keep many opens in flight through io_uring */
+} CrawlEngine;
+
+typedef enum traversal {
+    TRAVERSAL_BFS       = 0,    /* Directories are shared through the work queue, breadth-first */
+    TRAVERSAL_DFS       = 1,    /* Each thread crawls its own sub-directories first, depth-first */
+    TRAVERSAL_HYBRID    = 2     /* Breadth-first until the frontier passes a limit, then depth-first */
+} Traversal;
+
 /**
  * A container used for storing all of the program arguments.
  * When argp parses the command line arguments, the results will be stored here.
  */
 typedef struct prog_args {
     char regex[BUFFER_SIZE];                    /* The REGEX used for searching file/directory patterns */
+    char pattern[BUFFER_SIZE];                  /* The bash pattern REGEX is converted from */
+    char prune[BUFFER_SIZE];                    /* The REGEX of directory names not to crawl, if any */
+    char pruneGlobs[BUFFER_SIZE];               /* The bash patterns it's converted from, each NUL terminated */
     char searchPaths[MAX_DIRS][BUFFER_SIZE];    /* List of directories to recursively search in */
     int nPaths;                                 /* Number of paths in search paths array */
     int maxDepth;                               /* Max depth for recursive calls to sub-folders */
     int minDepth;                               /* Min depth to traverse before matching files */
     long maxResults;                            /* The max number of results to display */
-    int nThreads;                               /* Number of PThreads to use */
+    int nThreads;                               /* Number of PThreads to use, the most tuned with '-X auto' */
+    int autoThreads;                            /* Threads the tuning starts from with '-X auto', 0 if fixed */
+    long dirBufferSize;                         /* Size of each thread's directory read buffer */
+    char skipFsTypes[BUFFER_SIZE];              /* Comma separated filesystem types to skip */
+    CrawlEngine engine;                         /* The engine used to open directories */
+    int ioDepth;                                /* Max operations each thread keeps in flight */
+    Traversal traversal;                        /* The order directories are crawled in */
+    long frontierLimit;                         /* Queued directories past which hybrid goes depth-first */
+    int inlineLimit;                            /* Sub-directories each thread keeps to crawl itself, 0 if none */
+    int deviceLimit;                            /* Limit on every device, DEVICE_LIMIT_AUTO, or 0 if none */
+    char limitPaths[MAX_LIMITS][BUFFER_SIZE];   /* Paths on the devices limits are set on */
+    int limits[MAX_LIMITS];                     /* The limit set on each of those devices */
+    int nLimits;                                /* Number of devices limits are set on */
+    long stallAfter;                            /* Milliseconds before a thread is stuck, 0 if never */
+    int stallThreads;                           /* Max threads let through in place of stuck ones */
+    long splitAfter;                            /* Entries read before idle threads help read a directory */
+    long spillAfter;                            /* Queued directories held in memory before spilling, 0 if never */
+    char spillDir[BUFFER_SIZE];                 /* Directory to spill queued directories to */
+    char historyFile[BUFFER_SIZE];              /* File the cost of each large directory is kept in, if any */
     unsigned int progFlags;                     /* Holds all the boolean-style flags */
 } ProgArgs;
 
@@ -0,0 +1,135 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _COST_HISTORY_H__
+#define _COST_HISTORY_H__
+
+#include "cds_common.h"
+
+/**
+ * Interface for the CostHistory ADT.
+ *
+ * The cost of crawling each large directory on a past crawl: the time spent reading
+ * its whole subtree, and the number of entries in it. The costs of a past crawl are
+ * loaded from a file and looked up while crawling, and the costs of the current crawl
+ * are recorded by any number of threads, then saved back to the file.
+ *
+ * The file holds a line per directory: the nanoseconds spent, the number of entries,
+ * and the path, separated by a space. Paths end with a '/'.
+ */
+typedef struct cost_history CostHistory;
+
+/**
+ * Creates a new, empty history, then stores the new instance into '*history'.
+ *
+ * Params:
+ *    history - The pointer address to store the new CostHistory instance.
+ * Returns:
+ *    OK - CostHistory was successfully created.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status cost_history_new(CostHistory **history);
+
+/**
+ * Loads the costs saved to the file 'file' into the history, to be looked up. Lines
+ * that cannot be parsed are skipped. Must be called before any thread uses the history.
+ *
+ * Params:
+ *    history - The history to operate on.
+ *    file - The file to load the costs from.
+ * Returns:
+ *    OK - The costs were loaded.
+ *    NOT_FOUND - The file could not be opened.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status cost_history_load(CostHistory *history, const char *file);
+
+/**
+ * Looks up the cost loaded for the directory whose path is 'dir', which ends with a
+ * '/', followed by 'name' and a '/'.
+ *
+ * Params:
+ *    history - The history to operate on.
+ *    dir - The path of the directory's parent, with a trailing '/'.
+ *    name - The directory's name.
+ * Returns:
+ *    The nanoseconds spent crawling the directory's subtree, or 0 if it was not loaded.
+ */
+long cost_history_find(CostHistory *history, const char *dir, const char *name);
+
+/**
+ * Records that the tree under the directory 'path' is crawled on the current crawl, so
+ * the costs saved for directories in it are replaced by those recorded, and dropped if
+ * none are. Must be called before any thread uses the history.
+ *
+ * Params:
+ *    history - The history to operate on.
+ *    path - The directory's path, with a trailing '/'.
+ * Returns:
+ *    OK - The tree was added.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status cost_history_crawled(CostHistory *history, const char *path);
+
+/**
+ * Records the cost of crawling the directory 'path' on the current crawl. May be
+ * called by any number of threads at once.
+ *
+ * Params:
+ *    history - The history to operate on.
+ *    path - The directory's path, with a trailing '/'.
+ *    nanos - The nanoseconds spent crawling its subtree.
+ *    entries - The number of entries in its subtree.
+ * Returns:
+ *    OK - The cost was recorded.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status cost_history_record(CostHistory *history, const char *path, long nanos, long entries);
+
+/**
+ * Saves the costs recorded on the current crawl to the file 'file', costliest first,
+ * along with those it already held for directories outside the trees crawled. The file
+ * is read again first, so costs saved by another crawl in the meantime are kept. It is written
+ * under a temporary name, then renamed, so a crawl that is cut short leaves the old file
+ * intact.
+ *
+ * Params:
+ *    history - The history to operate on.
+ *    file - The file to save the costs to.
+ * Returns:
+ *    0 if successful, or the errno of the call that failed.
+ */
+int cost_history_save(CostHistory *history, const char *file);
+
+/**
+ * Destroys the history instance by freeing all of its reserved memory.
+ *
+ * Params:
+ *    history - The history to destroy. Nothing is done if NULL.
+ * Returns:
+ *    None
+ */
+void cost_history_destroy(CostHistory *history);
+
+#endif  /* _COST_HISTORY_H__ */
@@ -0,0 +1,67 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CPU_TOPOLOGY_H__
+#define _CPU_TOPOLOGY_H__
+
+#include "cds_common.h"
+
+/**
+ * A CPU the process may run on, and the NUMA node it belongs to.
+ */
+typedef struct {
+    int cpu;                /* The CPU number */
+    int node;               /* Index of its node, from 0 up to the number of nodes listed */
+} CpuInfo;
+
+/**
+ * Lists the CPUs in the process' affinity mask into a new array, grouped by NUMA node
+ * as listed in '/sys/devices/system/node', then stores the array into '*cpus'. Nodes
+ * are numbered in order from 0, leaving out those with none of the CPUs. CPUs of no
+ * listed node (e.g. on a kernel without NUMA support) are all put on one node.
+ *
+ * Params:
+ *    cpus - The pointer address to store the new array into, to be freed by the caller.
+ *    nCpus - The pointer address to store the number of CPUs into.
+ *    nNodes - The pointer address to store the number of nodes into.
+ * Returns:
+ *    OK - The CPUs were listed.
+ *    NOT_FOUND - The affinity mask could not be read.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status cpu_topology_load(CpuInfo **cpus, int *nCpus, int *nNodes);
+
+/**
+ * Returns the number of CPUs the process may run on: those in its affinity mask, cut
+ * down to its cgroup's CPU quota, if it has one (cgroup v2 'cpu.max', or the v1 CFS
+ * quota and period).
+ *
+ * Params:
+ *    None
+ * Returns:
+ *    The number of CPUs available, at least 1.
+ */
+int cpu_topology_available(void);
+
+#endif  /* _CPU_TOPOLOGY_H__ */
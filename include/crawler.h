@@ -25,6 +25,8 @@
 #ifndef _FILE_CRAWLER_H__
 #define _FILE_CRAWLER_H__
 
+#include <stdatomic.h>
+#include <stdint.h>
 #include "arg_parser.h"
 #include "regex_engine.h"
 #include "ts_treeset.h"
@@ -32,30 +34,75 @@
 
 /**
  * Structure to represent a directory to search as part of the file crawler.
+ *
+ * Rather than storing its full path, a directory stores a reference to its parent
+ * along with its own entry name, and is opened relative to the parent's open file
+ * descriptor. The full path is only assembled when it needs to be displayed.
  */
 typedef struct crawler_directory {
-    char *path;         /* The full directory path */
-    int minDepth;       /* The minimum depth to traverse before searching */
-    int maxDepth;       /* The max depth in sub-directories to crawl into */
+    struct crawler_directory *parent;   /* The parent directory, NULL for a search path */
+    char *name;                         /* The entry name, or the full path for a search path, kept after the struct */
+    int fd;                             /* The open descriptor kept for children, or -1 */
+    int readFd;                         /* The descriptor its entries are being read from */
+    atomic_int readers;                 /* Number of threads reading its entries */
+    int split;                          /* Set if this is a request to help read 'parent' */
+    int shared;                         /* Set while it holds a slot of its device in the work queue */
+    atomic_int refs;                    /* Number of references held on the directory */
+    uint64_t dev;                       /* Device the directory is on, inherited unless its entry was resolved */
+    uint64_t mntId;                     /* Mount the directory is on, with mount options only */
+    uint64_t rootDev;                   /* Device of the search path it was found under */
+    int minDepth;                       /* The minimum depth to traverse before searching */
+    int maxDepth;                       /* The max depth in sub-directories to crawl into */
+    atomic_long entries;                /* Entries read in its subtree so far, with a cost history only */
+    atomic_long nanos;                  /* Nanoseconds spent reading its subtree so far, likewise */
+    long cost;                          /* Nanoseconds its subtree took on a past crawl, 0 if unknown */
 } CrDir;
 
+/**
+ * Sets up the allocator CrDir* objects are created from. Must be called once, before
+ * any CrDir* object is created.
+ *
+ * Params:
+ *    None
+ * Returns:
+ *    OK - The allocator was set up.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status crawler_dir_setup(void);
+
+/**
+ * Releases the allocator CrDir* objects are created from. Must only be called once every
+ * CrDir* object has been freed, and every thread that created or freed one has exited.
+ *
+ * Params:
+ *    None
+ * Returns:
+ *    None
+ */
+void crawler_dir_teardown(void);
+
 /**
  * Creates a new CrDir* object and returns the pointer to the new instance, or
- * NULL if allocation fails.
+ * NULL if allocation fails. If 'parent' is not NULL, the new directory holds a
+ * reference on it until the new directory is freed.
  *
  * Params:
- *    dir - The directory path.
- *    depth - The max depth to traverse.
+ *    parent - The parent directory, or NULL if 'dir' is a search path.
+ *    dir - The entry name, or the directory path if 'parent' is NULL.
+ *    maxDepth - The max depth to traverse.
+ *    minDepth - The min depth to traverse before matching.
  * Returns:
  *    The new CrDir*, or NULL if allocation failed.
  */
-CrDir *crawler_dir_malloc(char dir[], int maxDepth, int minDepth);
+CrDir *crawler_dir_malloc(CrDir *parent, const char *dir, int maxDepth, int minDepth);
 
 /**
- * Destroys the specified CrDir* object by freeing its reserved heap memory.
+ * Releases a reference on the specified CrDir* object. Once the last reference is
+ * released, its open descriptor is closed, its reserved heap memory is freed, and
+ * the reference it holds on its parent is released.
  *
  * Params:
- *    dir - The CrDir* object to deallocate.
+ *    dir - The CrDir* object to release.
  * Returns:
  *    None
  */
@@ -67,13 +114,14 @@ void crawler_dir_free(CrDir *dir);
  *
  * Params:
  *    regex - The regex engine that will perform the string comparisons.
+ *    prune - The regex engine matching directory names not to crawl, or NULL.
  *    results - The set where the results will be stored.
  *    paths - The queue of paths to search in.
  *    progArgs - The program arguments.
  * Returns:
  *    None
  */
-void process(RegexEngine *regex, ConcurrentTreeSet *results, WorkQueue *paths, ProgArgs *progArgs);
+void process(RegexEngine *regex, RegexEngine *prune, ConcurrentTreeSet *results, WorkQueue *paths, ProgArgs *progArgs);
 
 /**
  * Displays all matched results contained in 'results'.
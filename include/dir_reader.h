@@ -0,0 +1,115 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _DIR_READER_H__
+#define _DIR_READER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Default size (in bytes) of the buffer handed to the kernel on each read */
+#define DIR_READER_DEFAULT_SIZE (128 * 1024)
+/* Smallest buffer size accepted; the kernel rejects buffers too small for one record */
+#define DIR_READER_MIN_SIZE 1000
+
+/**
+ * A raw directory entry record, laid out exactly as it is returned from the
+ * 'getdents64()' system call. Records are read in place from the reader's buffer,
+ * so the name is only valid until the next call to 'dir_reader_next()'.
+ */
+typedef struct linux_dirent64 {
+    uint64_t d_ino;             /* The entry's inode number */
+    int64_t d_off;              /* Offset to the next record */
+    unsigned short d_reclen;    /* Length of this record */
+    unsigned char d_type;       /* The entry's type (DT_DIR, DT_REG, etc.) */
+    char d_name[];              /* The null-terminated entry name */
+} DirEntry;
+
+/**
+ * Interface for the directory reader ADT.
+ *
+ * Reads the entries of an open directory file descriptor with 'getdents64()' into
+ * a single reusable buffer. A reader is meant to be owned by a single thread and
+ * reused for every directory that thread visits, so no allocations are made once
+ * the reader has been created.
+ */
+typedef struct dir_reader DirReader;
+
+/**
+ * Creates a new instance of the DirReader and returns a pointer to the new instance,
+ * or NULL if allocation failed.
+ *
+ * Params:
+ *    size - Size of the read buffer in bytes (DIR_READER_DEFAULT_SIZE if 0).
+ * Returns:
+ *    A DirReader* to the new instance, or NULL if allocation failed.
+ */
+DirReader *dir_reader_new(size_t size);
+
+/**
+ * Prepares the reader to read the entries of the open directory 'fd'. Any entries
+ * left over from the previous directory are discarded. The reader does not take
+ * ownership of the file descriptor.
+ *
+ * Params:
+ *    reader - The DirReader to operate on.
+ *    fd - The open directory file descriptor.
+ * Returns:
+ *    None
+ */
+void dir_reader_open(DirReader *reader, int fd);
+
+/**
+ * Returns the next entry of the directory, refilling the buffer from the kernel
+ * as needed, or NULL once all entries have been read or a read fails.
+ *
+ * Params:
+ *    reader - The DirReader to operate on.
+ * Returns:
+ *    The next DirEntry*, or NULL if there are no more entries.
+ */
+DirEntry *dir_reader_next(DirReader *reader);
+
+/**
+ * Returns the errno value of the last failed read, or 0 if the last directory was
+ * read without errors.
+ *
+ * Params:
+ *    reader - The DirReader to operate on.
+ * Returns:
+ *    The errno value of the last failed read, or 0.
+ */
+int dir_reader_error(DirReader *reader);
+
+/**
+ * Destroys the specified DirReader by returning its allocated heap memory.
+ *
+ * Params:
+ *    reader - The DirReader to destroy.
+ * Returns:
+ *    None
+ */
+void dir_reader_destroy(DirReader *reader);
+
+#endif  /* _DIR_READER_H__ */
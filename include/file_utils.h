@@ -25,6 +25,8 @@
 #ifndef _FILE_UTILS_H__
 #define _FILE_UTILS_H__
 
+#include <stddef.h>
+
 /**
  * Adds the specified file separator 'sep' to the end of the specified file path 'path'
  * if it is not present, otherwise does nothing. The path buffer is modified in place and
@@ -50,4 +52,30 @@ char *file_path_append(char path[], char sep);
  */
 char *file_path_deduct(char path[], char sep);
 
+/**
+ * Parses the size string 'str' into a number of bytes. The number may be followed by
+ * a single unit suffix: 'B' (bytes), 'k' (kilobytes), 'M' (megabytes), 'G' (gigabytes),
+ * or 'T' (terabytes), e.g. '512', '64k', '2M'.
+ *
+ * Params:
+ *    str - The size string to parse.
+ * Returns:
+ *    The size in bytes, or -1 if the string is not a valid size.
+ */
+long long file_size_parse(const char *str);
+
+/**
+ * Formats the number of bytes 'size' into the char array 'buffer' in the largest unit
+ * that keeps the number at or above 1, using the same units as 'file_size_parse()'
+ * (e.g. '512B', '64.0k', '2.5M').
+ *
+ * Params:
+ *    size - The number of bytes to format.
+ *    buffer - The char array to store the formatted size.
+ *    len - The max size of the buffer.
+ * Returns:
+ *    The formatted size.
+ */
+char *file_size_format(long long size, char buffer[], size_t len);
+
 #endif  /* _FILE_UTILS_H__ */
@@ -0,0 +1,94 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _GLOB_MATCHER_H__
+#define _GLOB_MATCHER_H__
+
+#include "cds_common.h"
+
+/**
+ * Declaration for the GlobMatcher ADT.
+ *
+ * Matches names against bash patterns without going through a regex. Each pattern is
+ * compiled into a short program of literal characters, '?', character classes and '*',
+ * and the common shapes are matched with plain string comparisons instead: an exact
+ * name, a literal prefix ('lit*'), a literal suffix ('*lit'), and a literal anywhere
+ * ('*lit*'). A name matches if it matches any of the patterns added.
+ *
+ * Names are matched the way the pattern's regex is matched with REG_NEWLINE: a name
+ * holding newlines matches if any of its lines matches. Once built, the matcher is only
+ * ever read, so any number of threads may match with it at once.
+ */
+typedef struct glob_matcher GlobMatcher;
+
+/**
+ * Constructs a new matcher without any pattern, then stores the new instance into
+ * '*matcher'.
+ *
+ * Params:
+ *    matcher - The pointer address to store the new GlobMatcher instance.
+ *    ignoreCase - Set to match letters regardless of their case.
+ * Returns:
+ *    OK - GlobMatcher was successfully created.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status glob_matcher_new(GlobMatcher **matcher, int ignoreCase);
+
+/**
+ * Compiles the bash pattern 'pattern' and adds it to the matcher. Only '*', '?' and
+ * bracket expressions are understood; patterns using any other regex syntax (e.g. '+',
+ * '|', '^', or '[[:alpha:]]') are left to the regex engine.
+ *
+ * Params:
+ *    matcher - The matcher to operate on.
+ *    pattern - The bash pattern to add.
+ * Returns:
+ *    0 if the pattern was added.
+ *    1 if it uses syntax the matcher does not handle, or allocation failed.
+ */
+int glob_matcher_add(GlobMatcher *matcher, const char *pattern);
+
+/**
+ * Returns 1 if the name 'name' matches any of the patterns added to the matcher, 0 if
+ * not.
+ *
+ * Params:
+ *    matcher - The matcher to operate on.
+ *    name - The name to match.
+ * Returns:
+ *    1 if the name matches, 0 if not.
+ */
+int glob_matcher_isMatch(const GlobMatcher *matcher, const char *name);
+
+/**
+ * Destroys the matcher instance by freeing all of its reserved memory.
+ *
+ * Params:
+ *    matcher - The matcher to destroy.
+ * Returns:
+ *    None
+ */
+void glob_matcher_destroy(GlobMatcher *matcher);
+
+#endif  /* _GLOB_MATCHER_H__ */
@@ -0,0 +1,87 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _INODE_SET_H__
+#define _INODE_SET_H__
+
+#include <stdint.h>
+#include "cds_common.h"
+
+/**
+ * Declaration for the thread-safe InodeSet ADT.
+ *
+ * A set of (device, inode) pairs identifying files that have already been seen. The
+ * set is split into a fixed number of shards, each a hash table with a lock of its
+ * own, so threads adding different files rarely contend with each other.
+ */
+typedef struct inode_set InodeSet;
+
+/**
+ * Constructs a new, empty inode set, then stores the new instance into '*set'.
+ *
+ * Params:
+ *    set - The pointer address to store the new InodeSet instance.
+ * Returns:
+ *    OK - InodeSet was successfully created.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status inode_set_new(InodeSet **set);
+
+/**
+ * Adds the file identified by 'dev' and 'ino' to the set if it is not already present.
+ * Checking and adding is a single atomic step, so when several threads add the same
+ * file, exactly one of them gets OK.
+ *
+ * Params:
+ *    set - The set to operate on.
+ *    dev - The file's device number.
+ *    ino - The file's inode number.
+ * Returns:
+ *    OK - Operation was successful.
+ *    ALREADY_EXISTS - Specified file is already present.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status inode_set_add(InodeSet *set, uint64_t dev, uint64_t ino);
+
+/**
+ * Returns the number of files in the set.
+ *
+ * Params:
+ *    set - The set to operate on.
+ * Returns:
+ *    The set's current size.
+ */
+long inode_set_size(InodeSet *set);
+
+/**
+ * Destroys the inode set instance by freeing all of its reserved memory.
+ *
+ * Params:
+ *    set - The set to destroy.
+ * Returns:
+ *    None
+ */
+void inode_set_destroy(InodeSet *set);
+
+#endif  /* _INODE_SET_H__ */
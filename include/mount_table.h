@@ -0,0 +1,131 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MOUNT_TABLE_H__
+#define _MOUNT_TABLE_H__
+
+#include <stdint.h>
+#include "cds_common.h"
+
+/**
+ * A single mount, as listed in '/proc/self/mountinfo'.
+ */
+typedef struct {
+    uint64_t id;            /* The mount ID, as reported by STATX_MNT_ID */
+    uint64_t parentId;      /* The ID of the mount it is mounted on */
+    uint64_t dev;           /* The device number of the mounted filesystem */
+    char *root;             /* The directory of the filesystem mounted, '/' unless a bind mount */
+    char *mountPoint;       /* Where the filesystem is mounted */
+    char *fsType;           /* The filesystem type (e.g. ext4, proc) */
+} MountInfo;
+
+/**
+ * Interface for the MountTable ADT.
+ *
+ * A snapshot of the mounts visible to the process. Besides looking mounts up, the
+ * table picks which of the mounts of a subtree mounted in several places (e.g. bind
+ * mounts) it is visited through, so that it is only visited once. The pick depends
+ * only on the search paths and the mounts, never on the order they are reached in.
+ */
+typedef struct mount_table MountTable;
+
+/**
+ * Loads the mounts listed in '/proc/self/mountinfo' into a new mount table, then
+ * stores the new instance into '*table'.
+ *
+ * Params:
+ *    table - The pointer address to store the new MountTable instance.
+ * Returns:
+ *    OK - MountTable was successfully created.
+ *    NOT_FOUND - The mount information could not be read.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status mount_table_new(MountTable **table);
+
+/**
+ * Looks up the mount with the ID 'id'. If the ID is 0 (the kernel does not report
+ * mount IDs), the first mount of the device 'dev' is looked up instead.
+ *
+ * Params:
+ *    table - The table to operate on.
+ *    id - The mount ID to look up, or 0.
+ *    dev - The device number to look up if 'id' is 0.
+ * Returns:
+ *    The MountInfo*, or NULL if no such mount was present when the table was loaded.
+ */
+const MountInfo *mount_table_find(MountTable *table, uint64_t id, uint64_t dev);
+
+/**
+ * Adds the search path 'path'. The part of its filesystem under the path is visited
+ * from the path itself, and every mount under the path is taken to be reachable.
+ * Search paths are preferred over mounts, in the order they are added.
+ *
+ * Params:
+ *    table - The table to operate on.
+ *    path - The search path to add.
+ * Returns:
+ *    OK - The path was added.
+ *    NOT_FOUND - The path could not be resolved.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status mount_table_add_path(MountTable *table, const char *path);
+
+/**
+ * Picks, once all search paths are added, which mounts are duplicates: those whose
+ * subtree lies within another subtree of the same filesystem that is visited, either
+ * one strictly containing it, or the same subtree reached from a search path or a
+ * reachable mount with a lower ID. Must be called only once.
+ *
+ * Params:
+ *    table - The table to operate on.
+ * Returns:
+ *    OK - The duplicates were picked.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status mount_table_resolve(MountTable *table);
+
+/**
+ * Returns whether the mount 'mount', as returned by 'mount_table_find()', is a
+ * duplicate that is visited through another mount or a search path. The table is
+ * only read, so any number of threads may call this at once.
+ *
+ * Params:
+ *    table - The table to operate on.
+ *    mount - The mount to check.
+ * Returns:
+ *    TRUE if the mount is a duplicate, FALSE if not.
+ */
+Boolean mount_table_is_duplicate(const MountTable *table, const MountInfo *mount);
+
+/**
+ * Destroys the mount table instance by freeing all of its reserved memory.
+ *
+ * Params:
+ *    table - The table to destroy.
+ * Returns:
+ *    None
+ */
+void mount_table_destroy(MountTable *table);
+
+#endif  /* _MOUNT_TABLE_H__ */
@@ -36,6 +36,10 @@
  * the number of items it may contain. Inserts can be performed as long as memory
  * or the system allows it.
  *
+ * The items are kept in a circular array that doubles in size whenever it fills up,
+ * rather than in a node allocated per item. The array never shrinks, so once the
+ * queue has grown, adding and polling items allocates nothing.
+ *
  * Modeled after the Java 7 Queue interface.
  */
 typedef struct queue Queue;
@@ -88,6 +92,21 @@ Status queue_peek(Queue *queue, void **first);
  */
 Status queue_poll(Queue *queue, void **first);
 
+/**
+ * Moves up to 'max' elements from the front of the queue 'other' to the rear of the
+ * queue 'queue', keeping their order. Moving all of the elements into an empty queue
+ * takes constant time, as the two queues trade their arrays; otherwise, the elements
+ * are copied over, and 'queue' may need to grow to hold them.
+ *
+ * Params:
+ *    queue - The queue to move the elements to.
+ *    other - The queue to move the elements from.
+ *    max - The max number of elements to move, or a negative number to move them all.
+ * Returns:
+ *    The number of elements moved (0 if 'queue' could not grow).
+ */
+long queue_splice(Queue *queue, Queue *other, long max);
+
 /**
  * Removes all elements from the queue. If 'destructor' is not NULL, it will be
  * invoked on each element in the queue after being removed.
@@ -25,6 +25,8 @@
 #ifndef _REGEX_ENGINE_H__
 #define _REGEX_ENGINE_H__
 
+#include <stddef.h>
+
 /* Status returned when the regex fails to compile */
 #define CMP_FAIL 1
 /* Status returned when caller attempts to match an expression before compiling regex */
@@ -36,9 +38,19 @@
 
 /**
  * Interface for the Regex engine ADT.
+ *
+ * The engine holds the compiled pattern, and is only changed while it's compiled. Once
+ * compiled, it's shared by any number of threads, each matching through a context of
+ * its own: the context holds all the state a match writes to, so threads never wait on
+ * one another to match.
  */
 typedef struct regex_engine RegexEngine;
 
+/**
+ * Interface for the context a single thread matches a RegexEngine through.
+ */
+typedef struct regex_context RegexContext;
+
 /**
  * A dedicated struct to identify each match found during execution.
  */
@@ -59,10 +71,9 @@ typedef struct {
 RegexEngine *regex_engine_new(int max);
 
 /**
- * Compiles the specified regular expression pattern 'pattern' to be used in subsequent
- * calls to 'regex_engine_isMatch()' and 'regex_engine_execute()'. The 'flags' argument are
- * the flags accepted by the internal call to regcomp (e.g., REG_EXTENDED, REG_ICASE, etc).
- * Returns 0 if compilation is successful.
+ * Compiles the specified regular expression pattern 'pattern' to be matched by the contexts
+ * created afterwards. The 'flags' argument are the flags accepted by the internal call to
+ * regcomp (e.g., REG_EXTENDED, REG_ICASE, etc). Returns 0 if compilation is successful.
  *
  * Params:
  *    regex - The RegexEngine to operate on.
@@ -75,70 +86,113 @@ RegexEngine *regex_engine_new(int max);
 int regex_engine_compile_pattern(RegexEngine *regex, const char *pattern, int flags);
 
 /**
- * Compares the string 'str' against the last compiled regex pattern, and returns 1 if a
+ * Adds the bash pattern 'glob' to the patterns matched without a regex, replacing any regex
+ * compiled before; a string matches if it matches any of them. The pattern is matched as its
+ * conversion to a regex would be with REG_EXTENDED and REG_NEWLINE; of the 'flags', only
+ * REG_ICASE is taken into account, from the first call. Patterns using more of the regex
+ * syntax than '*', '?' and brackets are not added, and are left for the caller to convert
+ * and compile with 'regex_engine_compile_pattern()'.
+ *
+ * Params:
+ *    regex - The RegexEngine to operate on.
+ *    glob - The bash pattern to add.
+ *    flags - Flags the converted pattern would be compiled with.
+ * Returns:
+ *    0 if successful.
+ *    CMP_FAIL if the pattern needs the regex, or allocation failed.
+ */
+int regex_engine_add_glob(RegexEngine *regex, const char *glob, int flags);
+
+/**
+ * Analyzes the last failed status code returned from 'regcomp()' and loads a description
+ * string into the char array 'buffer' that can be used for error printing.
+ *
+ * Params:
+ *    regex - The RegexEngine to operate on.
+ *    buffer - The char array to store the error message.
+ *    size - The max size of the buffer.
+ * Returns:
+ *    0 if successful.
+ *    NO_ERROR if there is no previous error.
+ */
+int regex_engine_error(RegexEngine *regex, char buffer[], size_t size);
+
+/**
+ * Destroys the specified RegexEngine by returning its allocated heap memory. Every context
+ * created from it must have been destroyed first.
+ *
+ * Params:
+ *    regex - The RegexEngine to destroy.
+ * Returns:
+ *    None
+ */
+void destroy_regex_engine(RegexEngine *regex);
+
+/**
+ * Creates a new context to match the pattern compiled into 'regex' with, and returns a
+ * pointer to the new instance, or NULL if allocation failed. A context must only be used
+ * by one thread at a time. As glibc serializes the matches made with the same compiled
+ * regex, each context compiles the regex again for itself; bash patterns added as globs
+ * need no compiling.
+ *
+ * Params:
+ *    regex - The compiled RegexEngine to match with.
+ * Returns:
+ *    A RegexContext* to the new instance, or NULL if allocation failed.
+ */
+RegexContext *regex_context_new(const RegexEngine *regex);
+
+/**
+ * Compares the string 'str' against the pattern of the context's engine, and returns 1 if a
  * match is found, 0 if not; 0 can also be returned if no regex was successfully compiled prior.
- * Unlike 'regex_engine_execute()', this search will not save any matches found.
+ * Unlike 'regex_context_execute()', this search will not save any matches found.
  *
  * Params:
- *     regex - The RegexEngine to operate on.
+ *     context - The RegexContext to operate on.
  *     str - The string to search.
  * Returns:
  *     1 if a match is found.
  *     0 if no matches found or no previous regex has been compiled.
  */
-int regex_engine_isMatch(RegexEngine *regex, const char *str);
+int regex_context_isMatch(RegexContext *context, const char *str);
 
 /**
- * Compares the string 'str' against the last compiled regex pattern, then saves all the matched
- * results that can be fetched ina subsequent call to 'regex_engine_getMatches()'. Returns 0 if at
- * least one match was found.
+ * Compares the string 'str' against the regex of the context's engine, then saves all the
+ * matched results that can be fetched in a subsequent call to 'regex_context_getMatches()'.
+ * Returns 0 if at least one match was found. Bash patterns added as globs are not executed.
  *
  * Params:
- *    regex - The RegexEngine to operate on.
+ *    context - The RegexContext to operate on.
  *    str - The string to search.
  * Returns:
  *    0 if successful.
  *    NO_CMP if no previous regex has been compiled.
  *    NO_MATCH if no matches were found.
  */
-int regex_engine_execute(RegexEngine *regex, const char *str);
+int regex_context_execute(RegexContext *context, const char *str);
 
 /**
- * Fetches all the matches from the last call to 'regex_engine_execute()' and loads the results
+ * Fetches all the matches from the last call to 'regex_context_execute()' and loads the results
  * into '*matches'.
  *
  * Params:
- *    regex - The RegexEngine to operate on.
+ *    context - The RegexContext to operate on.
  *    matches - Pointer to array where to load matches.
  *    len - The number of matches.
  * Returns:
  *    0 if successful.
  *    NO_MATCH if no previous matches exist.
  */
-int regex_engine_getMatches(RegexEngine *regex, RegexMatch **matches, int *len);
+int regex_context_getMatches(RegexContext *context, RegexMatch **matches, int *len);
 
 /**
- * Analyzes the last failed status code returned from 'regcomp()' or 'regexec()' and loads a
- * description string into the char array 'buffer' that can be used for error printing.
+ * Destroys the specified RegexContext by returning its allocated heap memory.
  *
  * Params:
- *    regex - The RegexEngine to operate on.
- *    buffer - The char array to store the error message.
- *    size - The max size of the buffer.
- * Returns:
- *    0 if successful.
- *    NO_ERROR if there is no previous error.
- */
-int regex_engine_error(RegexEngine *regex, char buffer[], size_t size);
-
-/**
- * Destroys the specified RegexEngine by returning its allocated heap memory.
- *
- * Params:
- *    regex - The RegexEngine to destroy.
+ *    context - The RegexContext to destroy.
  * Returns:
  *    None
  */
-void destroy_regex_engine(RegexEngine *regex);
+void regex_context_destroy(RegexContext *context);
 
 #endif  /* _REGEX_ENGINE_H__ */
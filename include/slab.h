@@ -0,0 +1,93 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SLAB_H__
+#define _SLAB_H__
+
+#include <stddef.h>
+#include "cds_common.h"
+
+/**
+ * Declaration for the Slab ADT.
+ *
+ * A thread-caching allocator for small blocks. Blocks are rounded up to a size class
+ * and carved from large chunks, each thread carving from its own. Freed blocks go on
+ * the freeing thread's own list for their class, and are handed out again from there,
+ * so that neither allocating nor freeing takes a lock in the common case. Only once a
+ * thread's list grows long, or runs dry, are blocks moved to or from the lists shared
+ * by all threads, in bulk. Blocks larger than the largest class come from the heap.
+ *
+ * The memory of the chunks is only given back to the heap once the slab is destroyed.
+ */
+typedef struct slab Slab;
+
+/**
+ * Constructs a new slab with size classes for blocks up to 'maxSize' bytes, then stores
+ * the new instance into '*slab'.
+ *
+ * Params:
+ *    slab - The pointer address to store the new Slab instance.
+ *    maxSize - The size of the largest block served from the slab.
+ * Returns:
+ *    OK - Slab was successfully created.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status slab_new(Slab **slab, size_t maxSize);
+
+/**
+ * Allocates a block of 'size' bytes from the slab. The block is aligned for any type.
+ *
+ * Params:
+ *    slab - The slab to allocate from.
+ *    size - The size of the block.
+ * Returns:
+ *    The block, or NULL if allocation failed.
+ */
+void *slab_alloc(Slab *slab, size_t size);
+
+/**
+ * Returns the block 'block' to the slab. It may be freed by any thread, not only the
+ * one that allocated it.
+ *
+ * Params:
+ *    slab - The slab the block was allocated from.
+ *    block - The block to free.
+ *    size - The size the block was allocated with.
+ * Returns:
+ *    None
+ */
+void slab_free(Slab *slab, void *block, size_t size);
+
+/**
+ * Destroys the slab instance by freeing all of its reserved memory, including any block
+ * not yet freed. Every other thread that used the slab must have exited.
+ *
+ * Params:
+ *    slab - The slab to destroy.
+ * Returns:
+ *    None
+ */
+void slab_destroy(Slab *slab);
+
+#endif  /* _SLAB_H__ */
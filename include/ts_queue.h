@@ -0,0 +1,176 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CDS_TS_QUEUE_H__
+#define _CDS_TS_QUEUE_H__
+
+#include "cds_common.h"
+#include "ts_iterator.h"
+
+/**
+ * Declaration for the thread-safe Queue ADT.
+ *
+ * A first-in-first-out (FIFO) queue that any number of threads may add to and poll
+ * from at once. Items are kept in a bounded ring that is added to and polled from
+ * without locking; once the ring is full, further items go to an unbounded overflow
+ * queue behind a lock, and are moved back into the ring as it drains. The queue as a
+ * whole is therefore unbounded.
+ *
+ * Items added by the same thread are polled in the order they were added; the order of
+ * items added by different threads at the same time is unspecified.
+ *
+ * Modeled after the Java 7 ConcurrentLinkedQueue interface.
+ */
+typedef struct ts_queue ConcurrentQueue;
+
+/**
+ * Creates a new queue instance whose ring holds 'capacity' items, rounded up to a power
+ * of 2, then stores the new instance into '*queue'.
+ *
+ * Params:
+ *    queue - The pointer address to store the new Queue instance.
+ *    capacity - The number of items the ring holds before overflowing.
+ * Returns:
+ *    OK - Queue was successfully created.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status ts_queue_new(ConcurrentQueue **queue, long capacity);
+
+/**
+ * Inserts the specified element into the queue.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ *    item - The item to be inserted into the queue.
+ * Returns:
+ *    OK - Operation was successful.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status ts_queue_add(ConcurrentQueue *queue, void *item);
+
+/**
+ * Retrieves, but does not remove, the first element from the queue and stores
+ * the result into '*first'. Another thread may poll the element right after.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ *    first - The pointer address to store the first element into.
+ * Returns:
+ *    OK - Operation was successful.
+ *    STRUCT_EMPTY - Queue is currently empty.
+ */
+Status ts_queue_peek(ConcurrentQueue *queue, void **first);
+
+/**
+ * Removes the first element from the queue and stores the result into '*first'.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ *    first - The pointer address to store the removed first element into.
+ * Returns:
+ *    OK - Operation was successful.
+ *    STRUCT_EMPTY - Queue is currently empty.
+ */
+Status ts_queue_poll(ConcurrentQueue *queue, void **first);
+
+/**
+ * Removes all elements from the queue. If 'destructor' is not NULL, it will be
+ * invoked on each element in the queue after being removed.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ *    destructor - Function to operate on each element after removal.
+ * Returns:
+ *    None
+ */
+void ts_queue_clear(ConcurrentQueue *queue, void (*destructor)(void *));
+
+/**
+ * Returns the number of elements in the queue. While other threads add or poll, the
+ * size may be out of date as soon as it's returned.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ * Returns:
+ *    The queue's current size.
+ */
+long ts_queue_size(ConcurrentQueue *queue);
+
+/**
+ * Returns TRUE if the queue contains no elements, FALSE if otherwise.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ * Returns:
+ *    TRUE if the queue is empty, FALSE if not.
+ */
+Boolean ts_queue_isEmpty(ConcurrentQueue *queue);
+
+/**
+ * Allocates and generates an array containing all of the queue's elements in proper
+ * sequence (from the first to last element), then stores the array into '*array'.
+ * Caller is responsible for freeing the array when finished. Elements polled while the
+ * array is made may or may not be in it.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ *    array - Address where the new array will be stored.
+ * Returns:
+ *    OK - Operation was successful.
+ *    STRUCT_EMPTY - Queue is currently empty.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status ts_queue_toArray(ConcurrentQueue *queue, Array **array);
+
+/**
+ * Creates an Iterator instance to iterate over the queue's elements in proper
+ * sequence (from first to last element), then stores the iterator into '*iter'.
+ * Caller is responsible for destroying the iterator instance when finished. The
+ * overflow queue stays locked until then; the ring is not, so elements polled while
+ * the iterator is made may or may not be in it.
+ *
+ * Params:
+ *    queue - The queue to operate on.
+ *    iter - Address where the new iterator will be stored.
+ * Returns:
+ *    OK - Operation was successful.
+ *    STRUCT_EMPTY - Queue is currently empty.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status ts_queue_iterator(ConcurrentQueue *queue, ConcurrentIterator **iter);
+
+/**
+ * Destroys the queue instance by freeing all of its reserved memory. If
+ * 'destructor' is not NULL, it will be invoked on each element before the queue is
+ * destroyed. No other thread may be using the queue.
+ *
+ * Params:
+ *    queue - The queue to destroy.
+ *    destructor - Function to operate on each element prior to queue destruction.
+ * Returns:
+ *    None
+ */
+void ts_queue_destroy(ConcurrentQueue *queue, void (*destructor)(void *));
+
+#endif  /* _CDS_TS_QUEUE_H__ */
@@ -0,0 +1,150 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _URING_H__
+#define _URING_H__
+
+/**
+ * Interface for the io_uring ADT.
+ *
+ * A thin wrapper over a single io_uring instance, driven directly through the
+ * 'io_uring_setup()' and 'io_uring_enter()' system calls. Operations are queued
+ * with one of the 'uring_prep_*()' methods, handed to the kernel with
+ * 'uring_submit()', and their results are collected with 'uring_complete()'. Each
+ * operation carries a caller-defined pointer that is returned with its result.
+ *
+ * A ring is not thread safe; it is meant to be owned by a single thread.
+ */
+typedef struct uring Uring;
+
+/* Declared in <sys/stat.h> when _GNU_SOURCE is defined */
+struct statx;
+
+/**
+ * Creates a new io_uring instance with room for 'entries' operations in flight, and
+ * returns a pointer to the new instance, or NULL if io_uring is unavailable (e.g. the
+ * kernel is too old or the system call is blocked) or allocation failed. On failure,
+ * errno describes the reason.
+ *
+ * Params:
+ *    entries - The number of operations the ring may hold in flight.
+ * Returns:
+ *    A Uring* to the new instance, or NULL on failure.
+ */
+Uring *uring_new(unsigned entries);
+
+/**
+ * Queues an 'openat()' of 'path' relative to the directory 'dfd'. The path must stay
+ * valid until the operation completes. The result of the operation is the new file
+ * descriptor, or the negated errno value on failure.
+ *
+ * Params:
+ *    ring - The Uring to operate on.
+ *    dfd - The directory the path is relative to, or AT_FDCWD.
+ *    path - The path to open.
+ *    flags - The flags to open the path with.
+ *    data - The pointer returned with the operation's result.
+ * Returns:
+ *    0 if successful.
+ *    1 if the ring is full.
+ */
+int uring_prep_openat(Uring *ring, int dfd, const char *path, int flags, void *data);
+
+/**
+ * Queues a 'statx()' of 'path' relative to the directory 'dfd', storing the requested
+ * fields into '*buf'. The path and buffer must stay valid until the operation completes.
+ * The result of the operation is 0, or the negated errno value on failure.
+ *
+ * Params:
+ *    ring - The Uring to operate on.
+ *    dfd - The directory the path is relative to, or AT_FDCWD.
+ *    path - The path to query.
+ *    flags - The 'AT_*' flags to pass along (e.g. AT_SYMLINK_NOFOLLOW).
+ *    mask - The 'STATX_*' fields being requested.
+ *    buf - The buffer to store the results into.
+ *    data - The pointer returned with the operation's result.
+ * Returns:
+ *    0 if successful.
+ *    1 if the ring is full.
+ */
+int uring_prep_statx(Uring *ring, int dfd, const char *path, int flags, unsigned mask,
+                     struct statx *buf, void *data);
+
+/**
+ * Submits all queued operations to the kernel, then waits until at least 'wait'
+ * operations have completed. Operations the kernel did not take stay queued and are
+ * submitted again by the next call.
+ *
+ * Params:
+ *    ring - The Uring to operate on.
+ *    wait - The number of completions to wait for (may be 0).
+ * Returns:
+ *    0 if successful.
+ *    EAGAIN if only some of the operations were taken, without waiting.
+ *    The errno value if the submission failed.
+ */
+int uring_submit(Uring *ring, unsigned wait);
+
+/**
+ * Removes the next completed operation from the ring, then stores its pointer into
+ * '*data' and its result into '*res'.
+ *
+ * Params:
+ *    ring - The Uring to operate on.
+ *    data - The pointer address to store the operation's pointer into.
+ *    res - The address to store the operation's result into.
+ * Returns:
+ *    0 if a completion was removed.
+ *    1 if no operations have completed.
+ */
+int uring_complete(Uring *ring, void **data, int *res);
+
+/**
+ * Takes back the newest operation queued that the kernel has not taken yet, then stores
+ * its pointer into '*data'. The kernel only takes operations while the thread using the
+ * ring is submitting them, so none is taken from under the caller.
+ *
+ * Params:
+ *    ring - The Uring to operate on.
+ *    data - The pointer address to store the operation's pointer into.
+ * Returns:
+ *    0 if an operation was taken back.
+ *    1 if the kernel has taken all of them.
+ */
+int uring_reclaim(Uring *ring, void **data);
+
+/**
+ * Destroys the specified Uring by unmapping its rings and closing its descriptor.
+ * Operations the kernel has taken are waited for first, so their buffers may be reused
+ * once this returns; their results are discarded. Operations not yet submitted are
+ * dropped.
+ *
+ * Params:
+ *    ring - The Uring to destroy.
+ * Returns:
+ *    None
+ */
+void uring_destroy(Uring *ring);
+
+#endif  /* _URING_H__ */
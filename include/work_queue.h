@@ -25,14 +25,36 @@
 #ifndef _WORK_QUEUE_H__
 #define _WORK_QUEUE_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.h"
+
 /**
  * Declared interface for the concurrent work queue ADT.
  *
  * Designed to be a thread safe queue containing work items to be processed by
- * some number of threads.
+ * some number of threads. Unless the queue has shards, lanes or a spill file, items
+ * are added and taken without locking; the lock is only taken to wait for work.
  */
 typedef struct work_queue WorkQueue;
 
+/* Largest record a spilled item may be written as */
+#define WORK_QUEUE_RECORD_MAX 8192
+
+/**
+ * Writes the item 'item' out as a record into 'buffer', which can hold up to 'size'
+ * bytes, then releases the item. Returns the length of the record, or 0 if the item
+ * cannot be spilled, in which case the item is left untouched and is kept in memory.
+ */
+typedef size_t (*WorkQueueWriter)(void *item, char *buffer, size_t size);
+
+/**
+ * Recreates an item from the record 'buffer' of 'len' bytes, as written by the queue's
+ * WorkQueueWriter. Returns the new item, or NULL if it could not be recreated, in
+ * which case the item is dropped.
+ */
+typedef void *(*WorkQueueReader)(const char *buffer, size_t len);
+
 /**
  * Creates a new instance of WorkQueue, then stores the new instance into the
  * address of '*queue'.
@@ -75,6 +97,252 @@ int work_queue_add(WorkQueue *queue, void *item);
  */
 int work_queue_poll(WorkQueue *queue, void **item);
 
+/**
+ * Removes the next item from the queue without waiting, then stores the result into
+ * '*item'. Unlike 'work_queue_poll()', the calling thread is still considered to be
+ * 'working' afterwards, whether or not an item was removed. This lets a thread take
+ * on more work while it still has items of its own in progress.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    item - The pointer address to store the removed item into.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (queue was empty).
+ */
+int work_queue_tryPoll(WorkQueue *queue, void **item);
+
+/**
+ * Splits the queue into 'shards' shards, so that each group of threads (e.g. those on
+ * the same NUMA node) mostly works on the items it added itself. Items added to a
+ * shard are taken from it first by the threads polling from it; other threads only
+ * take them once the shard they poll from and the inner queue are both empty. Items
+ * added without a shard go to the inner queue, shared by all. With lanes, items go to
+ * their lanes regardless of their shard.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    shards - The number of shards.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (allocation failed).
+ */
+int work_queue_shards(WorkQueue *queue, int shards);
+
+/**
+ * Same as 'work_queue_add()', except that the item is added to the shard 'shard'. If
+ * the queue has no such shard, the item is added as by 'work_queue_add()'.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    shard - The shard to add the item to.
+ *    item - The item to add.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (allocation failed).
+ */
+int work_queue_addTo(WorkQueue *queue, int shard, void *item);
+
+/**
+ * Same as 'work_queue_poll()', except that the shard 'shard' is taken from first.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    shard - The shard to take from first.
+ *    item - The pointer address to store the removed item into.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (queue was empty & all threads are waiting).
+ */
+int work_queue_pollFrom(WorkQueue *queue, int shard, void **item);
+
+/**
+ * Moves all the items in 'items' into the work queue, as if each was added in turn by
+ * 'work_queue_addTo()', but under a single lock at most. Only as many waiting threads
+ * are woken as there are new items.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    shard - The shard to add the items to.
+ *    items - The queue of items to add.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (allocation failed); the items not added are left in 'items'.
+ */
+int work_queue_addAll(WorkQueue *queue, int shard, Queue *items);
+
+/**
+ * Same as 'work_queue_pollFrom()', except that up to 'max' items are taken at once and
+ * added to the end of 'items'. Fewer are taken when there are other threads waiting, so
+ * that each is left its share. Items from a per-key lane are taken one at a time.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    shard - The shard to take from first.
+ *    items - The queue to add the removed items to.
+ *    max - The most items to take.
+ * Returns:
+ *    0 if successful (at least one item was taken).
+ *    1 if failed (queue was empty & all threads are waiting).
+ */
+int work_queue_pollAll(WorkQueue *queue, int shard, Queue *items, long max);
+
+/**
+ * Same as 'work_queue_tryPoll()', except that the shard 'shard' is taken from first.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    shard - The shard to take from first.
+ *    item - The pointer address to store the removed item into.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (queue was empty).
+ */
+int work_queue_tryPollFrom(WorkQueue *queue, int shard, void **item);
+
+/**
+ * Limits the number of threads working on the queue's items at once. Threads polling
+ * the queue past the limit are held back until enough of the working threads poll the
+ * queue again, or the limit is raised. Threads already working are never interrupted,
+ * and 'work_queue_tryPoll()' is not held back, since the calling thread is working.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    threads - The max number of threads working at once, or 0 for no limit.
+ * Returns:
+ *    None
+ */
+void work_queue_throttle(WorkQueue *queue, int threads);
+
+/**
+ * Adds another thread to those expected to access the queue, before the thread is
+ * started. Like all threads, it counts as working until it first polls the queue.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ * Returns:
+ *    None
+ */
+void work_queue_join(WorkQueue *queue);
+
+/**
+ * Removes the calling thread from those expected to access the queue, while it counts
+ * as working, i.e. outside of any poll; or removes a thread added with
+ * 'work_queue_join()' that could not be started. The thread must not access the queue
+ * afterwards, unless it joins it again.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ * Returns:
+ *    None
+ */
+void work_queue_leave(WorkQueue *queue);
+
+/**
+ * Returns the key of the lane the item 'item' belongs in (e.g. the device it's on).
+ */
+typedef uint64_t (*WorkQueueKey)(void *item);
+
+/**
+ * Returns the max number of items of the new lane 'key' that may be worked on at once,
+ * or 0 if there is no limit. 'arg' is the argument given to 'work_queue_lanes()'.
+ */
+typedef int (*WorkQueueLimit)(uint64_t key, void *arg);
+
+/**
+ * Splits the queue into lanes: each item is queued in the lane of its key, and each
+ * lane has its own limit on how many of its items may be worked on at once. Polling
+ * takes from the lanes in turn, skipping those at their limit, so a thread only waits
+ * when every lane with items is at its limit. An item taken from the queue counts
+ * against its lane until 'work_queue_done()' is called with its key. Items already
+ * in the queue are moved into their lanes.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    key - Gives the lane of an item.
+ *    limit - Gives the limit of a new lane, called once per lane.
+ *    arg - The argument passed to 'limit'.
+ * Returns:
+ *    0 if successful.
+ */
+int work_queue_lanes(WorkQueue *queue, WorkQueueKey key, WorkQueueLimit limit, void *arg);
+
+/**
+ * Returns the cost of the item 'item' (e.g. the time it took on a past run), or 0 if
+ * it has none.
+ */
+typedef long (*WorkQueueCost)(void *item);
+
+/**
+ * Has the items with a cost taken before all others, costliest first, so that the
+ * work expected to take longest starts soonest. Items are looked up with 'cost' as
+ * they are added; those without a cost are queued as usual. Items going into lanes
+ * keep to their lanes, and items with a cost are never spilled.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    cost - Gives the cost of an item.
+ * Returns:
+ *    0 if successful.
+ *    1 if failed (allocation failed).
+ */
+int work_queue_priority(WorkQueue *queue, WorkQueueCost cost);
+
+/**
+ * Releases the hold an item taken from the lane 'key' had on the lane, once the item
+ * is no longer being worked on.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    key - The key of the item's lane.
+ * Returns:
+ *    None
+ */
+void work_queue_done(WorkQueue *queue, uint64_t key);
+
+/**
+ * Has the queue spill items to a temporary file in the directory 'dir' once it holds
+ * 'limit' items in memory. Items keep their order: once items are spilled, every new
+ * item goes to the file as well, and the file is read back in batches when the items
+ * in memory run out. Memory then holds about 'limit' items, no matter how many are
+ * queued.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ *    limit - The number of items held in memory before spilling.
+ *    dir - The directory to create the temporary file in.
+ *    writer - Writes an item out as a record.
+ *    reader - Recreates an item from a record.
+ *    destructor - Releases an item read back that could not be queued.
+ * Returns:
+ *    0 if successful, otherwise the errno of the failure.
+ */
+int work_queue_spill(WorkQueue *queue, long limit, const char *dir, WorkQueueWriter writer,
+                     WorkQueueReader reader, void (*destructor)(void *));
+
+/**
+ * Returns the number of items spilled to the queue's temporary file so far.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ * Returns:
+ *    The number of items spilled.
+ */
+long work_queue_spilled(WorkQueue *queue);
+
+/**
+ * Returns the number of threads currently waiting on the queue for an item, leaving out
+ * those held back by 'work_queue_throttle()'. The count is read without locking, so it
+ * is only a hint: it may be stale by the time the caller acts on it. Threads holding
+ * work of their own may use it to decide when to share some of it.
+ *
+ * Params:
+ *    queue - The work queue to operate on.
+ * Returns:
+ *    The number of waiting threads.
+ */
+int work_queue_waiting(WorkQueue *queue);
+
 /**
  * Destroys the work queue instance by freeing all of its reserved memory. If 'destructor'
  * is not NULL, it will be invoked on each element before the queue is destroyed.
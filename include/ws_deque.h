@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _WS_DEQUE_H__
+#define _WS_DEQUE_H__
+
+#include "cds_common.h"
+
+/**
+ * Declaration for the WsDeque ADT.
+ *
+ * A work-stealing deque (Chase & Lev, 2005). Only its owner, a single thread, adds and
+ * takes items at the bottom, newest first, without locking. Any other thread may steal
+ * items from the top, oldest first; thieves only contend with each other, and with the
+ * owner only over the last item.
+ */
+typedef struct ws_deque WsDeque;
+
+/**
+ * Constructs a new, empty deque, then stores the new instance into '*deque'.
+ *
+ * Params:
+ *    deque - The pointer address to store the new WsDeque instance.
+ * Returns:
+ *    OK - WsDeque was successfully created.
+ *    ALLOC_FAILURE - Failed to allocate enough memory from the heap.
+ */
+Status ws_deque_new(WsDeque **deque);
+
+/**
+ * Adds the item 'item' to the bottom of the deque. Must only be called by the owner.
+ *
+ * Params:
+ *    deque - The deque to operate on.
+ *    item - The item to add.
+ * Returns:
+ *    OK - The item was added.
+ *    ALLOC_FAILURE - The deque could not grow to hold the item.
+ */
+Status ws_deque_push(WsDeque *deque, void *item);
+
+/**
+ * Takes the newest item from the bottom of the deque into '*item'. Must only be called
+ * by the owner.
+ *
+ * Params:
+ *    deque - The deque to operate on.
+ *    item - The pointer address to store the item into.
+ * Returns:
+ *    OK - An item was taken.
+ *    STRUCT_EMPTY - The deque was empty, or a thief took the last item first.
+ */
+Status ws_deque_take(WsDeque *deque, void **item);
+
+/**
+ * Steals the oldest item from the top of the deque into '*item'. May be called by any
+ * thread, including the owner.
+ *
+ * Params:
+ *    deque - The deque to operate on.
+ *    item - The pointer address to store the item into.
+ * Returns:
+ *    OK - An item was stolen.
+ *    STRUCT_EMPTY - The deque was empty, or another thread took the item first.
+ */
+Status ws_deque_steal(WsDeque *deque, void **item);
+
+/**
+ * Returns the number of items in the deque. Unless called by the owner with no thieves
+ * about, the count is only a hint: it may be stale by the time the caller acts on it.
+ *
+ * Params:
+ *    deque - The deque to operate on.
+ * Returns:
+ *    The number of items in the deque.
+ */
+long ws_deque_size(WsDeque *deque);
+
+/**
+ * Destroys the deque instance by freeing all of its reserved memory. If 'destructor' is
+ * not NULL, it will be invoked on each item left in the deque. No other thread may be
+ * using the deque.
+ *
+ * Params:
+ *    deque - The deque to destroy.
+ *    destructor - Function to operate on each item left prior to destruction.
+ * Returns:
+ *    None
+ */
+void ws_deque_destroy(WsDeque *deque, void (*destructor)(void *));
+
+#endif  /* _WS_DEQUE_H__ */
@@ -22,10 +22,14 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE
 #include <argp.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "arg_parser.h"
+#include "cpu_topology.h"
+#include "dir_reader.h"
 #include "file_utils.h"
 
 static ProgArgs *prog_args = NULL;
@@ -136,6 +140,9 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
         case 'i':
             prog_args->progFlags |= (1 << IGNORE_CASE);
             break;
+        case 'L':
+            prog_args->progFlags |= (1 << FOLLOW_LINKS);
+            break;
         case 200:
             {
                 int temp = strtol(arg, &after, 10);
@@ -156,13 +163,188 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
                 }
                 break;
             }
-        case 'X':
+        case 202:
+            {
+                long long temp = file_size_parse(arg);
+                if (temp < DIR_READER_MIN_SIZE || temp > (1LL << 30)) {
+                    argp_failure(state, 1, 0, "invalid directory buffer size: '%s' - must be a size between 1k and 1G.", arg);
+                } else {
+                    prog_args->dirBufferSize = (long)temp;
+                }
+                break;
+            }
+        case 203:
+            if (strcmp(arg, "sync") == 0) {
+                prog_args->engine = ENGINE_SYNC;
+            } else if (strcmp(arg, "uring") == 0) {
+                prog_args->engine = ENGINE_URING;
+            } else {
+                argp_failure(state, 1, 0, "invalid engine: '%s' - must be either 'sync' or 'uring'.", arg);
+            }
+            break;
+        case 204:
             {
                 int temp = strtol(arg, &after, 10);
+                if (temp <= 0 || temp > 4096) {
+                    argp_failure(state, 1, 0, "invalid I/O depth: '%s' - must be an int between 1 and 4096.", arg);
+                } else {
+                    prog_args->ioDepth = temp;
+                }
+                break;
+            }
+        case 205:
+            {
+                size_t len = strlen(prog_args->skipFsTypes);
+                if (len + strlen(arg) + 2 > BUFFER_SIZE)
+                    argp_failure(state, 1, 0, "too many filesystem types to skip: '%s'", arg);
+                if (len > 0)
+                    prog_args->skipFsTypes[len++] = ',';
+                strcpy(prog_args->skipFsTypes + len, arg);
+                break;
+            }
+        case 206:
+            prog_args->progFlags |= (1 << DEDUP_MOUNTS);
+            break;
+        case 207:
+            prog_args->progFlags |= (1 << INODE_ORDER);
+            break;
+        case 208:
+            if (strcmp(arg, "bfs") == 0) {
+                prog_args->traversal = TRAVERSAL_BFS;
+            } else if (strcmp(arg, "dfs") == 0) {
+                prog_args->traversal = TRAVERSAL_DFS;
+            } else if (strcmp(arg, "hybrid") == 0) {
+                prog_args->traversal = TRAVERSAL_HYBRID;
+            } else {
+                argp_failure(state, 1, 0, "invalid traversal: '%s' - must be either 'bfs', 'dfs' or 'hybrid'.", arg);
+            }
+            break;
+        case 209:
+            {
+                long temp = strtol(arg, &after, 10);
+                if (temp <= 0L || *after != '\0') {
+                    argp_failure(state, 1, 0, "invalid frontier limit: '%s' - must be a positive number.", arg);
+                } else {
+                    prog_args->frontierLimit = temp;
+                }
+                break;
+            }
+        case 210:
+            prog_args->progFlags |= (1 << SHOW_STATS);
+            break;
+        case 211:
+            {
+                long temp = strtol(arg, &after, 10);
+                if (temp <= 0L || *after != '\0') {
+                    argp_failure(state, 1, 0, "invalid spill limit: '%s' - must be a positive number.", arg);
+                } else {
+                    prog_args->spillAfter = temp;
+                }
+                break;
+            }
+        case 213:
+            {
+                long temp = strtol(arg, &after, 10);
+                if (temp < 0L || *after != '\0') {
+                    argp_failure(state, 1, 0, "invalid split threshold: '%s' - must be a non-negative number.", arg);
+                } else {
+                    prog_args->splitAfter = temp;
+                }
+                break;
+            }
+        case 219:
+            {
+                long temp = strtol(arg, &after, 10);
+                if (temp < 0L || temp > MAX_INLINE_LIMIT || *after != '\0') {
+                    argp_failure(state, 1, 0, "invalid inline limit: '%s' - must be an int between 0 and %d.", arg, MAX_INLINE_LIMIT);
+                } else {
+                    prog_args->inlineLimit = (int)temp;
+                }
+                break;
+            }
+        case 215:
+            {
+                /* Given without a time, threads are taken to be stuck after the default */
+                long temp = (arg != NULL) ? strtol(arg, &after, 10) : DEFAULT_STALL_AFTER;
+                if (temp < 0L || (arg != NULL && *after != '\0')) {
+                    argp_failure(state, 1, 0, "invalid stall time: '%s' - must be an int of 0 or greater.", arg);
+                } else {
+                    prog_args->stallAfter = temp;
+                }
+                break;
+            }
+        case 216:
+            {
+                long temp = strtol(arg, &after, 10);
+                if (temp <= 0L || temp > 1024L || *after != '\0') {
+                    argp_failure(state, 1, 0, "invalid stall thread count: '%s' - must be an int between 1 and 1024.", arg);
+                } else {
+                    prog_args->stallThreads = (int)temp;
+                }
+                break;
+            }
+        case 217:
+            prog_args->progFlags |= (1 << PIN_THREADS);
+            break;
+        case 214:
+            {
+                /* Either 'auto', 'N' for every device, or 'PATH=N' for the device PATH is on */
+                char *eq = strrchr(arg, '=');
+                long temp;
+                if (strcmp(arg, "auto") == 0) {
+                    prog_args->deviceLimit = DEVICE_LIMIT_AUTO;
+                    break;
+                }
+                temp = strtol((eq != NULL) ? (eq + 1) : arg, &after, 10);
+                if (temp <= 0L || temp > 4096L || *after != '\0') {
+                    argp_failure(state, 1, 0, "invalid device limit: '%s' - must be 'auto', N or PATH=N, with N between 1 and 4096.", arg);
+                } else if (eq == NULL) {
+                    prog_args->deviceLimit = (int)temp;
+                } else if (prog_args->nLimits == MAX_LIMITS) {
+                    argp_failure(state, 1, 0, "too many device limits, at most %d are allowed.", MAX_LIMITS);
+                } else if ((size_t)(eq - arg) >= BUFFER_SIZE || eq == arg) {
+                    argp_failure(state, 1, 0, "invalid device limit path: '%s'", arg);
+                } else {
+                    memcpy(prog_args->limitPaths[prog_args->nLimits], arg, eq - arg);
+                    prog_args->limitPaths[prog_args->nLimits][eq - arg] = '\0';
+                    prog_args->limits[prog_args->nLimits++] = (int)temp;
+                }
+                break;
+            }
+        case 212:
+            if (strlen(arg) >= BUFFER_SIZE)
+                argp_failure(state, 1, 0, "spill directory is too long: '%s'", arg);
+            strcpy(prog_args->spillDir, arg);
+            break;
+        case 218:
+            if (strlen(arg) >= BUFFER_SIZE)
+                argp_failure(state, 1, 0, "history file path is too long: '%s'", arg);
+            strcpy(prog_args->historyFile, arg);
+            break;
+        case 'x':
+            prog_args->progFlags |= (1 << ONE_FILE_SYSTEM);
+            break;
+        case 'X':
+            {
+                int temp;
+                /*
+                 * The count is tuned while crawling, starting from the available CPUs. Crawling
+                 * mostly waits on I/O, so the threads may grow past the CPUs, up to a limit.
+                 */
+                if (strcmp(arg, "auto") == 0) {
+                    prog_args->autoThreads = cpu_topology_available();
+                    temp = prog_args->autoThreads * AUTO_THREADS_SCALE;
+                    prog_args->nThreads = (temp < AUTO_THREADS_MAX) ? temp : AUTO_THREADS_MAX;
+                    if (prog_args->autoThreads > prog_args->nThreads)
+                        prog_args->autoThreads = prog_args->nThreads;
+                    break;
+                }
+                temp = strtol(arg, &after, 10);
                 if (temp <= 0) {
-                    argp_failure(state, 1, 0, "invalid thread count: '%s' - must be an int greater than 0.", arg);
+                    argp_failure(state, 1, 0, "invalid thread count: '%s' - must be an int greater than 0, or 'auto'.", arg);
                 } else {
                     prog_args->nThreads = temp;
+                    prog_args->autoThreads = 0;
                 }
                 break;
             }
@@ -176,6 +358,28 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
                 }
                 break;
             }
+        case 'P':
+            {
+                /* Each pattern is added as another alternative of the prune regex */
+                char buffer[BUFFER_SIZE];
+                size_t len = strlen(prog_args->prune), globsLen = 0;
+                if (*arg == '\0')
+                    argp_failure(state, 1, 0, "invalid prune pattern: '' - must not be empty.");
+                convert_to_bash(arg, buffer);
+                if (len + strlen(buffer) + 2 > BUFFER_SIZE)
+                    argp_failure(state, 1, 0, "too many prune patterns: '%s'", arg);
+                if (len > 0)
+                    prog_args->prune[len++] = '|';
+                strcpy(prog_args->prune + len, buffer);
+                /* The patterns themselves are kept one after the other, up to an empty one */
+                while (prog_args->pruneGlobs[globsLen] != '\0')
+                    globsLen += strlen(prog_args->pruneGlobs + globsLen) + 1;
+                if (globsLen + strlen(arg) + 2 > BUFFER_SIZE)
+                    argp_failure(state, 1, 0, "too many prune patterns: '%s'", arg);
+                strcpy(prog_args->pruneGlobs + globsLen, arg);
+                prog_args->pruneGlobs[globsLen + strlen(arg) + 1] = '\0';
+                break;
+            }
         case 'q':
             prog_args->progFlags |= (1 << QUIET);
             break;
@@ -189,6 +393,9 @@ static int parse_options(int key, char *arg, struct argp_state *state) {
             {
                 char buffer[BUFFER_SIZE];
                 (*arg_count)--;
+                if (strlen(arg) >= BUFFER_SIZE)
+                    argp_failure(state, 1, 0, "pattern too long: '%s'", arg);
+                strcpy(prog_args->pattern, arg);
                 convert_to_bash(arg, buffer);
                 strcpy(prog_args->regex, buffer);
                 break;
@@ -210,13 +417,34 @@ static struct argp_option options[] = {
     {"check-folders", 'F', 0, 0, "Includes folders in the search", 0},
     {"include", 'I', "DIR", 0, "Adds DIR to the search path", 0},
     {"ignore-case", 'i', 0, 0, "Performs a case-insensitive search", 0},
+    {"follow", 'L', 0, 0, "Follows symbolic links; each directory is still only crawled once", 0},
+    {"prune", 'P', "PATTERN", 0, "Does not crawl into directories whose name matches the bash PATTERN", 0},
+    {"one-file-system", 'x', 0, 0, "Does not crawl into directories on other filesystems than the search paths", 0},
+    {"skip-fstype", 205, "TYPES", 0, "Does not crawl into mounts of the comma separated filesystem TYPES (e.g. proc,sysfs)", 0},
+    {"dedup-mounts", 206, 0, 0, "Crawls a subtree mounted in several places (e.g. bind mounts) only once", 0},
     {"max-depth", 200, "N", 0, "Recursively searches no more than N subdirectories for each directory in the search path", 0},
     {"min-depth", 201, "N", 0, "Only search for matches that are at within least N subdirectories for each directory in the search path", 0},
-    {"threads", 'X', "N", 0, "Performs the search with N number of PThreads", 0},
+    {"threads", 'X', "N", 0, "Performs the search with N number of PThreads, or tunes the number while crawling if N is 'auto'", 0},
+    {"engine", 203, "ENGINE", 0, "Opens directories with ENGINE: 'sync' (default) or 'uring' (falls back to 'sync' if unavailable)", 0},
+    {"io-depth", 204, "N", 0, "Keeps up to N directory opens in flight per thread with the 'uring' engine", 0},
+    {"traversal", 208, "ORDER", 0, "Crawls directories in ORDER: 'bfs' (default), 'dfs' or 'hybrid'", 0},
+    {"frontier-limit", 209, "N", 0, "Goes depth-first once N directories are queued with the 'hybrid' traversal", 0},
+    {"inline-limit", 219, "N", 0, "Has each thread crawl up to N of the sub-directories it finds itself, right after their parent, while no thread is idle; 0 never does (default: 16)", 0},
+    {"device-limit", 214, "LIMIT", 0, "Crawls at most N directories at once per device: 'N' for every device, 'PATH=N' for the device of PATH, or 'auto'", 0},
+    {"pin", 217, 0, 0, "Pins each thread to a CPU, filling one NUMA node before the next, and has threads crawl the directories found on their own node first", 0},
+    {"stall-after", 215, "MS", OPTION_ARG_OPTIONAL, "Lets another thread crawl in place of each thread stuck in a call for MS milliseconds (default: 1000 if MS is left out); off unless given", 0},
+    {"stall-threads", 216, "N", 0, "Lets at most N threads crawl in place of stuck ones (default: 4)", 0},
+    {"split-after", 213, "N", 0, "Has idle threads help read directories with more than N entries; 0 never does (default: 16384)", 0},
+    {"spill-after", 211, "N", 0, "Spills queued directories to a temporary file once N are held in memory", 0},
+    {"spill-dir", 212, "DIR", 0, "Creates the spill file in DIR (default: $TMPDIR, or /tmp)", 0},
+    {"history", 218, "FILE", 0, "Crawls the directories that took longest on past crawls first, as recorded in FILE, then records the cost of this crawl's large directories in FILE", 0},
+    {"inode-order", 207, 0, 0, "Opens the sub-directories of each directory in inode order; faster on spinning disks", 0},
+    {"dir-buffer", 202, "SIZE", 0, "Reads directory entries into a SIZE byte buffer per thread (e.g. 64k, 1M)", 0},
     {0, 0, 0, 0, "Output Options", 2},
     {"max-results", 'M', "N", 0, "Display no more than N results", 0},
     {"quiet", 'q', 0, 0, "Prints only the number of matches, not the matches themselves", 0},
     {"reverse", 'r', 0, 0, "Reverses the sorting when displaying the matches", 0},
+    {"stats", 210, 0, 0, "Prints statistics about the crawl once it's done", 0},
     {"no-warn", 'W', 0, 0, "Suppresses all error & waring messages during file crawling", 0},
     { 0 }
 };
@@ -236,7 +464,26 @@ int prog_args_parse(int argc, char **argv, ProgArgs **progArgs) {
         prog_args->minDepth = 0;
         prog_args->maxResults = 0;
         prog_args->nThreads = 1;
+        prog_args->autoThreads = 0;
+        prog_args->dirBufferSize = DIR_READER_DEFAULT_SIZE;
+        prog_args->engine = ENGINE_SYNC;
+        prog_args->ioDepth = DEFAULT_IO_DEPTH;
+        prog_args->traversal = TRAVERSAL_BFS;
+        prog_args->frontierLimit = DEFAULT_FRONTIER_LIMIT;
+        prog_args->inlineLimit = DEFAULT_INLINE_LIMIT;
+        prog_args->deviceLimit = 0;
+        prog_args->nLimits = 0;
+        prog_args->stallAfter = 0L;
+        prog_args->stallThreads = DEFAULT_STALL_THREADS;
+        prog_args->splitAfter = DEFAULT_SPLIT_AFTER;
+        prog_args->spillAfter = 0L;
+        prog_args->spillDir[0] = '\0';
+        prog_args->historyFile[0] = '\0';
         prog_args->progFlags = 0;
+        prog_args->skipFsTypes[0] = '\0';
+        prog_args->prune[0] = '\0';
+        prog_args->pruneGlobs[0] = '\0';
+        prog_args->pattern[0] = '\0';
     }
 
     if ((result = argp_parse(&argps, argc, argv, 0, 0, &arg_count)) == 0) {
@@ -0,0 +1,385 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cost_history.h"
+
+/* Initial number of costs the history holds before growing */
+#define INITIAL_COSTS 64L
+
+/*
+ * The cost of crawling a directory's subtree.
+ */
+typedef struct {
+    char *path;                 /* The directory's path */
+    long nanos;                 /* Nanoseconds spent crawling its subtree */
+    long entries;               /* Number of entries in its subtree */
+} Cost;
+
+/*
+ * Struct for the history. The costs loaded are looked up in an open-addressed hash
+ * table with linear probing; the costs recorded are only ever appended to.
+ */
+struct cost_history {
+    Cost *loaded;               /* The costs loaded */
+    long nLoaded;               /* Number of costs loaded */
+    long *slots;                /* Table of indices into 'loaded', -1 where empty */
+    long nSlots;                /* Number of slots in the table (0, or a power of 2) */
+    pthread_mutex_t lock;       /* The lock guarding the costs recorded */
+    Cost *recorded;             /* The costs recorded on the current crawl */
+    long nRecorded;             /* Number of costs recorded */
+    long capacity;              /* Number of costs the recorded array holds */
+    char **roots;               /* The trees crawled on the current crawl */
+    int nRoots;                 /* Number of trees crawled */
+};
+
+Status cost_history_new(CostHistory **history) {
+
+    CostHistory *temp;
+
+    if ((temp = (CostHistory *)malloc(sizeof(CostHistory))) == NULL)
+        return ALLOC_FAILURE;
+
+    temp->loaded = NULL;
+    temp->nLoaded = 0L;
+    temp->slots = NULL;
+    temp->nSlots = 0L;
+    temp->recorded = NULL;
+    temp->nRecorded = 0L;
+    temp->capacity = 0L;
+    temp->roots = NULL;
+    temp->nRoots = 0;
+    pthread_mutex_init(&(temp->lock), NULL);
+    *history = temp;
+
+    return OK;
+}
+
+/*
+ * Adds the cost of 'path' to the array 'costs' of 'n' costs that holds '*capacity',
+ * growing it as needed. Returns OK if successful, ALLOC_FAILURE if not.
+ */
+static Status append_cost(Cost **costs, long *n, long *capacity, const char *path, long nanos, long entries) {
+
+    Cost *temp;
+    char *copy;
+
+    if (*n == *capacity) {
+        long size = (*capacity > 0L) ? 2L * *capacity : INITIAL_COSTS;
+        if ((temp = (Cost *)realloc(*costs, size * sizeof(Cost))) == NULL)
+            return ALLOC_FAILURE;
+        *costs = temp;
+        *capacity = size;
+    }
+    if ((copy = strdup(path)) == NULL)
+        return ALLOC_FAILURE;
+
+    (*costs)[*n].path = copy;
+    (*costs)[*n].nanos = nanos;
+    (*costs)[*n].entries = entries;
+    (*n)++;
+
+    return OK;
+}
+
+/*
+ * Folds the string 's' into the FNV-1a hash 'h'. A path is hashed the same whether it
+ * is folded in whole or in parts.
+ */
+static uint64_t hash(uint64_t h, const char *s) {
+
+    while (*s != '\0') {
+        h ^= (unsigned char)*s++;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/* The FNV-1a offset basis, the hash of the empty string */
+#define HASH_BASIS 0xCBF29CE484222325ULL
+
+/*
+ * Builds the hash table over the costs loaded. Returns OK if successful, ALLOC_FAILURE
+ * if not.
+ */
+static Status index_costs(CostHistory *history) {
+
+    long size = 1L, i, j;
+
+    /* Keeps the table at most half full */
+    while (size < 2L * history->nLoaded)
+        size <<= 1;
+    if ((history->slots = (long *)malloc(size * sizeof(long))) == NULL)
+        return ALLOC_FAILURE;
+    history->nSlots = size;
+    for (i = 0L; i < size; i++)
+        history->slots[i] = -1L;
+
+    for (i = 0L; i < history->nLoaded; i++) {
+        j = (long)(hash(HASH_BASIS, history->loaded[i].path) & (uint64_t)(size - 1L));
+        while (history->slots[j] >= 0L)
+            j = (j + 1L) & (size - 1L);
+        history->slots[j] = i;
+    }
+
+    return OK;
+}
+
+/*
+ * Reads the costs saved to the file 'file' onto the end of the array 'costs' of 'n'
+ * costs that holds '*capacity'. Lines that cannot be parsed are skipped. Returns OK if
+ * successful, NOT_FOUND if the file could not be opened, ALLOC_FAILURE if not.
+ */
+static Status read_costs(const char *file, Cost **costs, long *n, long *capacity) {
+
+    FILE *fp;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    long nanos, entries;
+    int offset;
+    Status status = OK;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        return NOT_FOUND;
+
+    while (status == OK && (len = getline(&line, &size, fp)) > 0) {
+        if (line[len - 1] == '\n')
+            line[len - 1] = '\0';
+        /* Each line is '<nanoseconds> <entries> <path>' */
+        if (sscanf(line, "%ld %ld %n", &nanos, &entries, &offset) != 2 || line[offset] == '\0' || nanos <= 0L)
+            continue;
+        status = append_cost(costs, n, capacity, line + offset, nanos, entries);
+    }
+    free(line);
+    fclose(fp);
+
+    return status;
+}
+
+Status cost_history_load(CostHistory *history, const char *file) {
+
+    long capacity = 0L;
+    Status status;
+
+    status = read_costs(file, &(history->loaded), &(history->nLoaded), &capacity);
+    if (status == OK && history->nLoaded > 0L)
+        status = index_costs(history);
+
+    return status;
+}
+
+long cost_history_find(CostHistory *history, const char *dir, const char *name) {
+
+    size_t dirLen, nameLen;
+    long i;
+    Cost *cost;
+
+    if (history->nSlots == 0L)
+        return 0L;
+
+    /* The path is looked up in its parts, as 'dir' + 'name' + '/' */
+    dirLen = strlen(dir);
+    nameLen = strlen(name);
+    i = (long)(hash(hash(hash(HASH_BASIS, dir), name), "/") & (uint64_t)(history->nSlots - 1L));
+    for (; history->slots[i] >= 0L; i = (i + 1L) & (history->nSlots - 1L)) {
+        cost = &(history->loaded[history->slots[i]]);
+        if (strncmp(cost->path, dir, dirLen) == 0 && strncmp(cost->path + dirLen, name, nameLen) == 0 &&
+            strcmp(cost->path + dirLen + nameLen, "/") == 0)
+            return cost->nanos;
+    }
+
+    return 0L;
+}
+
+Status cost_history_crawled(CostHistory *history, const char *path) {
+
+    char **temp;
+
+    if ((temp = (char **)realloc(history->roots, (history->nRoots + 1) * sizeof(char *))) == NULL)
+        return ALLOC_FAILURE;
+    history->roots = temp;
+    if ((temp[history->nRoots] = strdup(path)) == NULL)
+        return ALLOC_FAILURE;
+    history->nRoots++;
+
+    return OK;
+}
+
+/*
+ * Returns 1 if the directory 'path' lies in one of the trees crawled on the current
+ * crawl, 0 if not.
+ */
+static int crawled(CostHistory *history, const char *path) {
+
+    int i;
+
+    for (i = 0; i < history->nRoots; i++) {
+        if (strncmp(path, history->roots[i], strlen(history->roots[i])) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+Status cost_history_record(CostHistory *history, const char *path, long nanos, long entries) {
+
+    Status status;
+
+    /* A path with a line break could not be read back */
+    if (strchr(path, '\n') != NULL)
+        return OK;
+
+    pthread_mutex_lock(&(history->lock));
+    status = append_cost(&(history->recorded), &(history->nRecorded), &(history->capacity), path, nanos, entries);
+    pthread_mutex_unlock(&(history->lock));
+
+    return status;
+}
+
+/*
+ * Compares the costs 'a' and 'b', so that the costliest sorts first.
+ */
+static int compare_costs(const void *a, const void *b) {
+
+    long x = ((const Cost *)a)->nanos, y = ((const Cost *)b)->nanos;
+
+    return (x < y) ? 1 : ((x > y) ? -1 : 0);
+}
+
+/*
+ * Compares the paths of the costs 'a' and 'b'.
+ */
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(((const Cost *)a)->path, ((const Cost *)b)->path);
+}
+
+/*
+ * Merges the costs recorded on the current crawl with the array 'saved' of 'nSaved'
+ * costs saved before. Only the saved costs of directories outside the trees crawled
+ * are kept; those inside were either recorded again, or are gone or no longer large.
+ * Returns the merged costs, costliest first, storing their number into '*n'; they share
+ * their paths with the costs they came from. Returns NULL if allocation fails. Must hold
+ * the lock.
+ */
+static Cost *merge_costs(CostHistory *history, Cost *saved, long nSaved, long *n) {
+
+    Cost *merged;
+    long i, j = 0L, kept = 0L;
+    int cmp;
+
+    if ((merged = (Cost *)malloc((nSaved + history->nRecorded + 1L) * sizeof(Cost))) == NULL)
+        return NULL;
+
+    /* With both sorted by path, a saved cost is kept if no cost recorded has its path */
+    qsort(saved, nSaved, sizeof(Cost), compare_paths);
+    qsort(history->recorded, history->nRecorded, sizeof(Cost), compare_paths);
+    for (i = 0L; i < nSaved; i++) {
+        cmp = 1;
+        while (j < history->nRecorded && (cmp = strcmp(history->recorded[j].path, saved[i].path)) < 0)
+            j++;
+        if (cmp != 0 && !crawled(history, saved[i].path))
+            merged[kept++] = saved[i];
+    }
+    memcpy(merged + kept, history->recorded, history->nRecorded * sizeof(Cost));
+    *n = kept + history->nRecorded;
+    qsort(merged, *n, sizeof(Cost), compare_costs);
+
+    return merged;
+}
+
+int cost_history_save(CostHistory *history, const char *file) {
+
+    FILE *fp;
+    char *temp;
+    Cost *saved = NULL, *merged;
+    long nSaved = 0L, capacity = 0L, n = 0L, i;
+    int err = 0;
+
+    /* The file is read again, in case another crawl saved to it since it was loaded */
+    if (read_costs(file, &saved, &nSaved, &capacity) == ALLOC_FAILURE) {
+        err = ENOMEM;
+        goto done;
+    }
+    if (asprintf(&temp, "%s.tmp", file) < 0) {
+        err = ENOMEM;
+        goto done;
+    }
+    if ((fp = fopen(temp, "w")) == NULL) {
+        err = errno;
+        free(temp);
+        goto done;
+    }
+
+    pthread_mutex_lock(&(history->lock));
+    if ((merged = merge_costs(history, saved, nSaved, &n)) == NULL)
+        err = ENOMEM;
+    for (i = 0L; i < n; i++)
+        fprintf(fp, "%ld %ld %s\n", merged[i].nanos, merged[i].entries, merged[i].path);
+    pthread_mutex_unlock(&(history->lock));
+    free(merged);
+
+    if (err == 0 && ferror(fp))
+        err = EIO;
+    if (fclose(fp) != 0 && err == 0)
+        err = errno;
+    if (err == 0 && rename(temp, file) != 0)
+        err = errno;
+    if (err != 0)
+        (void)unlink(temp);
+    free(temp);
+
+done:
+    for (i = 0L; i < nSaved; i++)
+        free(saved[i].path);
+    free(saved);
+
+    return err;
+}
+
+void cost_history_destroy(CostHistory *history) {
+
+    long i;
+
+    if (history == NULL)
+        return;
+    for (i = 0L; i < history->nLoaded; i++)
+        free(history->loaded[i].path);
+    for (i = 0L; i < history->nRecorded; i++)
+        free(history->recorded[i].path);
+    free(history->loaded);
+    free(history->recorded);
+    free(history->slots);
+    for (i = 0L; i < history->nRoots; i++)
+        free(history->roots[i]);
+    free(history->roots);
+    pthread_mutex_destroy(&(history->lock));
+    free(history);
+}
@@ -0,0 +1,205 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_topology.h"
+
+/* Location of the NUMA nodes in sysfs */
+#define NODE_DIR "/sys/devices/system/node"
+
+/*
+ * Compares two node numbers, for sorting.
+ */
+static int compare_nodes(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Reads the NUMA node numbers listed in sysfs into a new array stored into '*nodes'.
+ * Returns the number of nodes, 0 if none are listed, or -1 if allocation failed.
+ */
+static int list_nodes(int **nodes) {
+
+    DIR *dir;
+    struct dirent *dent;
+    int *temp, n = 0, size = 0, node;
+
+    *nodes = NULL;
+    if ((dir = opendir(NODE_DIR)) == NULL)
+        return 0;
+    while ((dent = readdir(dir)) != NULL) {
+        if (sscanf(dent->d_name, "node%d", &node) != 1)
+            continue;
+        if (n == size) {
+            size = (size > 0) ? (size * 2) : 8;
+            if ((temp = (int *)realloc(*nodes, size * sizeof(int))) == NULL) {
+                free(*nodes);
+                closedir(dir);
+                return -1;
+            }
+            *nodes = temp;
+        }
+        (*nodes)[n++] = node;
+    }
+    closedir(dir);
+    qsort(*nodes, (size_t)n, sizeof(int), compare_nodes);
+
+    return n;
+}
+
+/*
+ * Reads the CPU list (e.g. '0-3,8-11') of the node 'node' into the set 'set'.
+ */
+static void read_cpulist(int node, cpu_set_t *set) {
+
+    char path[128], buffer[4096], *curr;
+    FILE *fp;
+    int first, last;
+
+    CPU_ZERO(set);
+    snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+    if ((fp = fopen(path, "r")) == NULL)
+        return;
+    if (fgets(buffer, sizeof(buffer), fp) != NULL) {
+        for (curr = strtok(buffer, ",\n"); curr != NULL; curr = strtok(NULL, ",\n")) {
+            if (sscanf(curr, "%d-%d", &first, &last) != 2)
+                last = first = atoi(curr);
+            for (; first <= last && first < CPU_SETSIZE; first++)
+                CPU_SET(first, set);
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * Reads a CPU quota from the cgroup file 'path', which holds either both the quota and its
+ * period ("QUOTA PERIOD", cgroup v2), or only the quota, with the period in 'periodPath'
+ * (cgroup v1). Returns the number of CPUs the quota amounts to, rounded up, or 0 if there
+ * is no quota.
+ */
+static int quota_cpus(const char *path, const char *periodPath) {
+
+    FILE *fp;
+    long quota = -1L, period = 0L;
+    char buffer[64];
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return 0;
+    if (fgets(buffer, sizeof(buffer), fp) != NULL && strncmp(buffer, "max", 3) != 0)
+        (void)sscanf(buffer, "%ld %ld", &quota, &period);
+    fclose(fp);
+
+    if (periodPath != NULL && (fp = fopen(periodPath, "r")) != NULL) {
+        if (fscanf(fp, "%ld", &period) != 1)
+            period = 0L;
+        fclose(fp);
+    }
+
+    return (quota > 0L && period > 0L) ? (int)((quota + period - 1L) / period) : 0;
+}
+
+int cpu_topology_available(void) {
+
+    cpu_set_t set;
+    FILE *fp;
+    char line[PATH_MAX], path[PATH_MAX + 32];
+    int cpus = 1, quota = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        cpus = CPU_COUNT(&set);
+
+    /* With cgroup v2, the quota is in the cpu.max of the program's own cgroup */
+    if ((fp = fopen("/proc/self/cgroup", "r")) != NULL) {
+        while (quota == 0 && fgets(line, sizeof(line), fp) != NULL) {
+            if (strncmp(line, "0::", 3) == 0) {
+                line[strcspn(line, "\n")] = '\0';
+                snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", line + 3);
+                quota = quota_cpus(path, NULL);
+            }
+        }
+        fclose(fp);
+    }
+    /* Inside a container, the program's cgroup is usually the root of its own hierarchy */
+    if (quota == 0)
+        quota = quota_cpus("/sys/fs/cgroup/cpu.max", NULL);
+    if (quota == 0)
+        quota = quota_cpus("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+
+    return (quota > 0 && quota < cpus) ? quota : cpus;
+}
+
+Status cpu_topology_load(CpuInfo **cpus, int *nCpus, int *nNodes) {
+
+    cpu_set_t allowed, nodeSet;
+    CpuInfo *temp;
+    int *nodes, n, i, cpu, count = 0, node = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return NOT_FOUND;
+    if ((temp = (CpuInfo *)malloc(CPU_COUNT(&allowed) * sizeof(CpuInfo))) == NULL)
+        return ALLOC_FAILURE;
+    if ((n = list_nodes(&nodes)) < 0) {
+        free(temp);
+        return ALLOC_FAILURE;
+    }
+
+    /* Takes each node's allowed CPUs in turn, numbering only the nodes that have some */
+    for (i = 0; i < n; i++) {
+        int before = count;
+        read_cpulist(nodes[i], &nodeSet);
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &nodeSet) && CPU_ISSET(cpu, &allowed)) {
+                temp[count].cpu = cpu;
+                temp[count++].node = node;
+                CPU_CLR(cpu, &allowed);
+            }
+        }
+        if (count > before)
+            node++;
+    }
+    free(nodes);
+
+    /* The CPUs left over were on no listed node */
+    if (CPU_COUNT(&allowed) > 0) {
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                temp[count].cpu = cpu;
+                temp[count++].node = node;
+            }
+        }
+        node++;
+    }
+
+    *cpus = temp;
+    *nCpus = count;
+    *nNodes = node;
+
+    return OK;
+}
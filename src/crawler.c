@@ -22,14 +22,116 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+#include <unistd.h>
+#include "cost_history.h"
+#include "cpu_topology.h"
 #include "crawler.h"
+#include "dir_reader.h"
+#include "file_utils.h"
+#include "inode_set.h"
+#include "mount_table.h"
+#include "slab.h"
+#include "uring.h"
+#include "ws_deque.h"
 
 #define LOG(str...) if (verbose) fprintf(stderr, str)
 
+/* Number of descriptors left unused for stdio, the threads' own opens, etc */
+#define FD_RESERVE 64
+
+/* Flags used to open every directory */
+#define OPEN_FLAGS (O_RDONLY|O_DIRECTORY|O_CLOEXEC)
+
+/* Number of entries read between checks for idle threads to help read a large directory */
+#define SPLIT_CHECK 1024
+
+/* Number of matches each thread collects before adding them to the results together */
+#define RESULT_BATCH 64
+
+/* Number of passes over the other workers an idle thread makes trying to steal */
+#define STEAL_ROUNDS 2
+/* Most sub-directories a thread holds before adding them all to the work queue */
+#define ADD_BATCH 64
+/* Most directories a thread takes from the work queue at once */
+#define POLL_BATCH 16
+
+/* Number of entries of unknown type resolved together in one batch */
+#define STAT_BATCH 64
+/* Flags used to resolve the type of an entry: never follow links, never wait on a server */
+#define STAT_FLAGS (AT_SYMLINK_NOFOLLOW|AT_STATX_DONT_SYNC)
+/* Flags used to resolve the type of an entry when following links */
+#define STAT_FOLLOW_FLAGS AT_STATX_DONT_SYNC
+/* Fields requested when resolving the type of an entry */
+#define STAT_MASK STATX_TYPE
+
+/*
+ * Descriptors held open for pending children are shared by all threads. The budget
+ * keeps the number held open under the process' RLIMIT_NOFILE.
+ */
+static atomic_long retainedFds = 0L;
+static long fdBudget = 0L;
+
+/*
+ * The frontier: sub-directories found but not yet crawled, and the heap memory they
+ * hold. Only tracked with the hybrid traversal, or for --stats.
+ */
+static atomic_long frontierDirs = 0L;
+static atomic_long frontierBytes = 0L;
+static atomic_long peakDirs = 0L;
+static atomic_long peakBytes = 0L;
+static int trackFrontier = 0;
+
+/*
+ * The cost history: the costs of a past crawl, looked up to queue the costliest
+ * directories first, and the costs of this crawl. NULL without --history.
+ */
+static CostHistory *history = NULL;
+
+/* Entries a subtree must hold for its cost to be recorded */
+#define HISTORY_MIN_ENTRIES 1000L
+
+/*
+ * The slab directories are allocated from, each along with its name. Every name but
+ * those of the search paths fits in a block of the slab.
+ */
+static Slab *dirSlab = NULL;
+#define DIR_SLAB_MAX (sizeof(CrDir) + NAME_MAX + 1)
+
+/* Number of threads still running, signaled as each one finishes */
+static pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t runCond = PTHREAD_COND_INITIALIZER;
+static int running = 0;
+
+/* Nanoseconds between each check on the threads while they crawl */
+#define MONITOR_INTERVAL 100000000L
+/* Change in the crawl rate below which a new thread count is not worth it */
+#define TUNE_MARGIN 0.05
+/* Number of measures at a steady thread count before trying another */
+#define TUNE_PROBE 10
+
+/* Limit on directories crawled at once on a spinning disk, when detecting limits */
+#define ROTATIONAL_LIMIT 2
+
+/*
+ * A limit on the number of directories crawled at once on a device.
+ */
+struct device_limit_t {
+    uint64_t dev;           /* The device */
+    int limit;              /* The max number of directories crawled on it at once */
+};
+
 /*
  * A struct that contains all the variables needed to run while processing the file
  * crawling logic. This single struct is cast as a 'void *' in the argument for the
@@ -37,177 +139,2078 @@
  */
 struct crawler_args_t {
     RegexEngine *regex;
+    RegexEngine *prune;     /* Matches the names of directories not to crawl, or NULL */
     ConcurrentTreeSet *results;
     WorkQueue *paths;
     ProgArgs *args;
+    InodeSet *visited;      /* Directories crawled so far, only kept when following links */
+    int openFlags;          /* Flags used to open sub-directories */
+    int statFlags;          /* Flags used to resolve the type of an entry */
+    unsigned statMask;      /* Fields requested when resolving an entry */
+    int mountAware;         /* Set if sub-directories are checked against the mount options */
+    int inodeOrder;         /* Set if sub-directories are queued in inode order */
+    int lanes;              /* Set if the work queue has a lane per device */
+    struct device_limit_t *limits;  /* Limits set on specific devices */
+    int nLimits;            /* Number of limits set on specific devices */
+    MountTable *mounts;     /* The mounts, only loaded for the options that need them */
+    CpuInfo *cpus;          /* The CPUs workers are pinned to in turn, NULL if not pinned */
+    int nCpus;              /* Number of CPUs workers are pinned to */
+    struct crawler_worker_t *workers;   /* The workers, which directories may be stolen from */
+    atomic_int nWorkers;    /* Number of workers started so far */
+    atomic_int keepWorkers; /* Workers from this index on retire once out of work */
+};
+
+/*
+ * A sub-directory held back, so that the sub-directories of a directory can be queued
+ * in inode order.
+ */
+struct held_dir_t {
+    uint64_t ino;                   /* The sub-directory's inode number */
+    size_t name;                    /* Offset of its name in the worker's held names buffer */
+    uint64_t dev;                   /* The device it's on */
+    uint64_t mntId;                 /* The mount it's on */
+};
+
+/*
+ * The state owned by a single crawler thread. Each thread keeps its own directory
+ * reader so that the read buffer is allocated once and reused for every directory.
+ */
+struct crawler_worker_t {
+    struct crawler_args_t *info;    /* The shared crawler state */
+    DirReader *reader;              /* The thread's directory reader */
+    Uring *ring;                    /* The thread's io_uring, NULL with the sync engine */
+    Uring *statRing;                /* The thread's io_uring for resolving entry types */
+    int fd;                         /* Descriptor of the directory being processed */
+    char *names;                    /* Names of entries waiting for their type to be resolved */
+    size_t namesSize;               /* The size of the names buffer */
+    size_t namesLen;                /* Number of bytes used in the names buffer */
+    size_t pending[STAT_BATCH];     /* Offset of each waiting entry's name in the names buffer */
+    struct statx stats[STAT_BATCH]; /* Buffers the waiting entries are resolved into */
+    int nPending;                   /* Number of entries waiting for their type */
+    struct held_dir_t *held;        /* Sub-directories waiting to be queued in inode order */
+    int nHeld;                      /* Number of sub-directories held */
+    int heldSize;                   /* The capacity of the held array */
+    char *heldNames;                /* Names of the held sub-directories */
+    size_t heldNamesSize;           /* The size of the held names buffer */
+    size_t heldNamesLen;            /* Number of bytes used in the held names buffer */
+    RegexContext *match;            /* The thread's context for matching names */
+    RegexContext *pruneMatch;       /* The thread's context for matching pruned names, or NULL */
+    CrDir **kept;                   /* Sub-directories the thread crawls itself, newest last */
+    int nKept;                      /* Number of sub-directories kept */
+    WsDeque *deque;                 /* Sub-directories kept by the thread, crawled depth-first */
+    Queue *batch;                   /* Sub-directories not yet added to the work queue */
+    unsigned int seed;              /* State of the thread's choice of whom to steal from */
+    atomic_long nDirs;              /* Number of directories crawled by the thread */
+    atomic_long progress;           /* Bumped as the thread gets through directories and entries */
+    atomic_int idle;                /* Set while the thread waits on the work queue */
+    int index;                      /* The worker's index among all of them */
+    int retiring;                   /* Set once the thread has left the work queue to retire */
+    atomic_int retired;             /* Set once the retiring thread has finished */
+    int started;                    /* Set while the thread is yet to be joined */
+    int cpu;                        /* The CPU the thread is pinned to, -1 if not pinned */
+    int node;                       /* The NUMA node of that CPU, its shard of the work queue */
+    char *found[RESULT_BATCH];      /* Matches not yet added to the results */
+    int nFound;                     /* Number of matches not yet added */
+    char *path;                     /* Buffer holding the path of 'pathDir' */
+    size_t pathSize;                /* The size of the path buffer */
+    long pathLen;                   /* Length of the path in the buffer */
+    CrDir *pathDir;                 /* The directory whose path is in the buffer, held, or NULL */
+    pthread_t thread;               /* The thread's ID */
 };
 
-CrDir *crawler_dir_malloc(char dir[], int maxDepth, int minDepth) {
+/*
+ * Returns the length of the path of 'crDir': the search path, then 'name/' for each
+ * descendant.
+ */
+static size_t crawler_dir_path_length(CrDir *crDir) {
+
+    CrDir *curr;
+    size_t len = 0;
+
+    for (curr = crDir; curr->parent != NULL; curr = curr->parent)
+        len += strlen(curr->name) + 1;
+    return len + strlen(curr->name);
+}
+
+/*
+ * Fills in the 'len' characters of the path of 'crDir' into 'buffer', from the last
+ * component to the first. The path is not terminated.
+ */
+static void crawler_dir_path_fill(CrDir *crDir, char *buffer, size_t len) {
+
+    CrDir *curr;
+    char *end = buffer + len;
+
+    for (curr = crDir; curr->parent != NULL; curr = curr->parent) {
+        size_t nameLen = strlen(curr->name);
+        *(--end) = '/';
+        end -= nameLen;
+        memcpy(end, curr->name, nameLen);
+    }
+    memcpy(buffer, curr->name, strlen(curr->name));
+}
+
+/*
+ * Adds the cost of the subtree of 'dir', now complete, to its parent's, and records it
+ * in the history if the subtree is large enough.
+ */
+static void record_cost(CrDir *dir) {
 
-    CrDir *crDir = NULL;
+    long entries = atomic_load(&(dir->entries)), nanos = atomic_load(&(dir->nanos));
+    size_t len;
     char *path;
 
-    if ((crDir = (CrDir *)malloc(sizeof(CrDir))) != NULL) {
+    /* Requests to help read a directory count toward the directory itself */
+    if (dir->split)
+        return;
+    if (dir->parent != NULL) {
+        atomic_fetch_add(&(dir->parent->entries), entries);
+        atomic_fetch_add(&(dir->parent->nanos), nanos);
+    }
+    if (entries < HISTORY_MIN_ENTRIES)
+        return;
+
+    len = crawler_dir_path_length(dir);
+    if ((path = (char *)malloc(len + 1)) != NULL) {
+        crawler_dir_path_fill(dir, path, len);
+        path[len] = '\0';
+        (void)cost_history_record(history, path, nanos, entries);
+        free(path);
+    }
+}
+
+void crawler_dir_free(CrDir *dir) {
+
+    CrDir *parent;
+
+    /* Releasing the last reference on a directory releases one on its parent */
+    while (dir != NULL && atomic_fetch_sub(&(dir->refs), 1) == 1) {
+        parent = dir->parent;
+        /* Its children are all freed by now, so its subtree's cost is complete */
+        if (history != NULL)
+            record_cost(dir);
+        if (dir->fd >= 0) {
+            close(dir->fd);
+            atomic_fetch_sub(&retainedFds, 1L);
+        }
+        slab_free(dirSlab, dir, sizeof(CrDir) + strlen(dir->name) + 1);
+        dir = parent;
+    }
+}
+
+Status crawler_dir_setup(void) {
+    return slab_new(&dirSlab, DIR_SLAB_MAX);
+}
+
+void crawler_dir_teardown(void) {
+
+    if (dirSlab != NULL) {
+        slab_destroy(dirSlab);
+        dirSlab = NULL;
+    }
+}
+
+CrDir *crawler_dir_malloc(CrDir *parent, const char *dir, int maxDepth, int minDepth) {
+
+    size_t len = strlen(dir) + 1;
+    CrDir *crDir;
+
+    /* The name is kept right after the directory, in the same block */
+    if ((crDir = (CrDir *)slab_alloc(dirSlab, sizeof(CrDir) + len)) != NULL) {
         /* If allocation is successful, initialize the members */
-        if ((path = strdup(dir)) != NULL) {
-            crDir->path = path;
-            crDir->maxDepth = maxDepth;
-            crDir->minDepth = minDepth;
-        } else {
-            free(crDir);
-            crDir = NULL;
+        crDir->parent = parent;
+        crDir->name = (char *)(crDir + 1);
+        memcpy(crDir->name, dir, len);
+        crDir->fd = -1;
+        crDir->readFd = -1;
+        atomic_init(&(crDir->readers), 0);
+        crDir->split = 0;
+        crDir->shared = 0;
+        atomic_init(&(crDir->refs), 1);
+        crDir->maxDepth = maxDepth;
+        crDir->minDepth = minDepth;
+        crDir->dev = 0;
+        crDir->mntId = 0;
+        crDir->rootDev = 0;
+        atomic_init(&(crDir->entries), 0L);
+        atomic_init(&(crDir->nanos), 0L);
+        crDir->cost = 0L;
+        /* The child keeps its parent (and its descriptor) alive, and starts on its mount */
+        if (parent != NULL) {
+            atomic_fetch_add(&(parent->refs), 1);
+            crDir->dev = parent->dev;
+            crDir->mntId = parent->mntId;
+            crDir->rootDev = parent->rootDev;
         }
     }
 
     return crDir;
 }
 
-void crawler_dir_free(CrDir *dir) {
+/*
+ * Opens the directory 'dir' relative to its parent's open descriptor with 'flags'. If
+ * the parent's descriptor was not kept open, the parent is reopened the same way first.
+ * Returns the new descriptor, or -1 if the directory could not be opened.
+ */
+static int crawler_dir_open(CrDir *dir, int flags) {
 
-    if (dir != NULL) {
-        free(dir->path);
-        free(dir);
+    int fd, parentFd;
+
+    /* Search paths are opened as given, following symbolic links */
+    if (dir->parent == NULL) {
+        do {
+            fd = open(dir->name, OPEN_FLAGS);
+        } while (fd < 0 && errno == EINTR);
+        return fd;
+    }
+
+    if ((parentFd = dir->parent->fd) >= 0) {
+        do {
+            fd = openat(parentFd, dir->name, flags);
+        } while (fd < 0 && errno == EINTR);
+    } else {
+        if ((parentFd = crawler_dir_open(dir->parent, flags)) < 0)
+            return -1;
+        do {
+            fd = openat(parentFd, dir->name, flags);
+        } while (fd < 0 && errno == EINTR);
+        /* Preserves the errno from openat() for the caller */
+        int err = errno;
+        close(parentFd);
+        errno = err;
     }
+
+    return fd;
 }
 
 /*
- * Prcoesses all the files currently in the open directory '*dir'.
- *
- * Will iterate through all entries in the directory.
- *   If a directory is found, add it to the work queue
- *   If a regular file is found, attempt to match against a regex
+ * Builds the full path of 'crDir', with a trailing '/', into the worker's path buffer.
+ * The worker holds on to the directory whose path is in the buffer, so that the path of
+ * the same directory is never built twice, and that of one of its children or siblings
+ * is built by appending its name, or swapping the last one. Returns the path, or NULL
+ * if the buffer could not be grown.
+ */
+static const char *crawler_dir_path(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    CrDir *last = worker->pathDir;
+    long base = -1L;
+    size_t len, nameLen = 0;
+
+    if (last == crDir)
+        return worker->path;
+
+    /* Only the last name differs from the path in the buffer */
+    if (last != NULL && crDir->parent != NULL) {
+        if (crDir->parent == last)
+            base = worker->pathLen;
+        else if (crDir->parent == last->parent)
+            base = worker->pathLen - (long)strlen(last->name) - 1L;
+    }
+    if (base >= 0L) {
+        nameLen = strlen(crDir->name);
+        len = (size_t)base + nameLen + 1;
+    } else {
+        len = crawler_dir_path_length(crDir);
+    }
+
+    if (len + 1 > worker->pathSize) {
+        char *temp = (char *)realloc(worker->path, len + 1);
+        if (temp == NULL)
+            return NULL;
+        worker->path = temp;
+        worker->pathSize = len + 1;
+    }
+
+    if (base >= 0L) {
+        memcpy(worker->path + base, crDir->name, nameLen);
+        worker->path[len - 1] = '/';
+    } else {
+        crawler_dir_path_fill(crDir, worker->path, len);
+    }
+    worker->path[len] = '\0';
+    worker->pathLen = (long)len;
+
+    atomic_fetch_add(&(crDir->refs), 1);
+    worker->pathDir = crDir;
+    if (last != NULL)
+        crawler_dir_free(last);
+
+    return worker->path;
+}
+
+/*
+ * Adds the matches collected by the worker to the results, all under one lock, so the
+ * results are not fought over for every match.
+ */
+static void flush_results(struct crawler_worker_t *worker) {
+
+    ConcurrentTreeSet *results = worker->info->results;
+    int i;
+
+    if (worker->nFound == 0)
+        return;
+    ts_treeset_lock(results);
+    for (i = 0; i < worker->nFound; i++) {
+        if (ts_treeset_add(results, worker->found[i]) != OK)
+            free(worker->found[i]);
+    }
+    ts_treeset_unlock(results);
+    worker->nFound = 0;
+}
+
+/*
+ * Adds the path of the entry 'name' inside 'crDir' to the set of results.
+ */
+static void add_result(struct crawler_worker_t *worker, CrDir *crDir, const char *name) {
+
+    const char *path;
+    size_t nameLen = strlen(name) + 1;
+    char *result;
+
+    /* The lengths are known, neither the path nor the name is scanned again */
+    if ((path = crawler_dir_path(worker, crDir)) == NULL)
+        return;
+    if ((result = (char *)malloc(worker->pathLen + nameLen)) != NULL) {
+        memcpy(result, path, worker->pathLen);
+        memcpy(result + worker->pathLen, name, nameLen);
+        if (worker->nFound == RESULT_BATCH)
+            flush_results(worker);
+        worker->found[worker->nFound++] = result;
+    }
+}
+
+/*
+ * Returns 1 if the filesystem type 'fsType' is in the comma separated list 'types'.
+ */
+static int fs_type_listed(const char *types, const char *fsType) {
+
+    size_t len = strlen(fsType);
+    const char *curr = types;
+
+    while (*curr != '\0') {
+        if (strncmp(curr, fsType, len) == 0 && (curr[len] == ',' || curr[len] == '\0'))
+            return 1;
+        if ((curr = strchr(curr, ',')) == NULL)
+            break;
+        curr++;
+    }
+
+    return 0;
+}
+
+/*
+ * Checks the sub-directory described by 'stx' against the mount options, before it is
+ * ever queued. The sub-directory's device and mount are stored into '*dev' and '*mntId'.
+ * Returns 1 if the sub-directory may be crawled, 0 if it is to be skipped.
  */
-static void process_directory(DIR *dir, CrDir *crDir, struct crawler_args_t *info) {
+static int check_mount(struct crawler_args_t *info, CrDir *crDir, const struct statx *stx,
+                       uint64_t *dev, uint64_t *mntId) {
 
-    RegexEngine *regex = info->regex;
-    ConcurrentTreeSet *results = info->results;
-    WorkQueue *paths = info->paths;
     unsigned int flags = info->args->progFlags;
-    struct dirent *dent;
-    char buffer[BUFFER_SIZE];
-    int maxDepth = crDir->maxDepth;
-    int minDepth = crDir->minDepth;
-    int verbose = !(GET_BIT(flags, NO_WARN));
+    const MountInfo *mount;
 
-    while ((dent = readdir(dir)) != NULL) {
+    *dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    *mntId = (stx->stx_mask & STATX_MNT_ID) ? stx->stx_mnt_id : 0;
 
-        /* Ignore current working directory and parent directory */
-        if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
-            continue;
+    /* Still on the same mount as its parent, there is nothing to check */
+    if (*dev == crDir->dev && (*mntId == 0 || *mntId == crDir->mntId))
+        return 1;
 
-        /* Ignore files & directories starting with '.' if --all is not specified */
-        if (strncmp(dent->d_name, ".", 1) == 0 && !GET_BIT(flags, SHOW_ALL))
-            continue;
+    /* --one-file-system: only devices of the search path are crawled */
+    if (GET_BIT(flags, ONE_FILE_SYSTEM) && *dev != crDir->rootDev)
+        return 0;
 
-        /* If entry is a directory, add it to list of paths to search */
-        if (dent->d_type == DT_DIR) {
-
-            /* If maximum depth has not been reached, add directory to work queue */
-            if (maxDepth != 0) {
-                sprintf(buffer, "%s%s/", crDir->path, dent->d_name);
-                CrDir *newDir = crawler_dir_malloc(buffer, (maxDepth - 1), (minDepth - 1));
-                if (newDir != NULL) {
-                    if (work_queue_add(paths, newDir) != OK) {
-                        free(newDir);
-                        LOG("Failed to allocate enough memory from the heap, skipping directory: %s", buffer);
-                    }
-                } else {
-                    LOG("Failed to allocate enough memory from the heap, skipping directory: %s", buffer);
-                }
-            }
+    if (info->mounts == NULL || (mount = mount_table_find(info->mounts, *mntId, *dev)) == NULL)
+        return 1;
+    /* --skip-fstype: mounts of the listed types are never entered */
+    if (info->args->skipFsTypes[0] != '\0' && fs_type_listed(info->args->skipFsTypes, mount->fsType))
+        return 0;
+    /*
+     * --dedup-mounts: a subtree mounted in several places is only entered through the
+     * mount picked by the table up front. Links may lead into the middle of a mount,
+     * which does not count as entering it.
+     */
+    if (GET_BIT(flags, DEDUP_MOUNTS) &&
+        (!(stx->stx_attributes_mask & STATX_ATTR_MOUNT_ROOT) || (stx->stx_attributes & STATX_ATTR_MOUNT_ROOT)) &&
+        mount_table_is_duplicate(info->mounts, mount) == TRUE)
+        return 0;
 
-            /* Checks the directory name against the regex */
-            /* Do so if -F flag is on and minimum depth has been reached */
-            if (GET_BIT(flags, CHECK_FOLDERS) && minDepth <= 0) {
-                /* If is a match, add the name to results */
-                if ((!(GET_BIT(flags, CONFLICT))) == regex_engine_isMatch(regex, dent->d_name)) {
-                    sprintf(buffer, "%s%s", crDir->path, dent->d_name);
-                    char *result = strdup(buffer);
-                    if (result != NULL) {
-                        if (ts_treeset_add(results, result) != OK)
-                            free(result);
-                    }
-                }
-            }
+    return 1;
+}
 
-        }
+/*
+ * Copies the name 'name' to the end of the buffer '*buf', growing it as needed. The
+ * buffer's size and used length are stored in '*size' and '*len'. Returns the offset
+ * of the copy, or -1 if the buffer could not grow.
+ */
+static long append_name(char **buf, size_t *size, size_t *len, const char *name) {
 
-        /* If entry is a normal file, check the name against the regex */
-        else if (dent->d_type == DT_REG) {
+    size_t n = strlen(name) + 1;
+    long offset;
 
-            /* Skip if the minimum depth has not been reached */
-            if (minDepth > 0)
-                continue;
+    if (*len + n > *size) {
+        size_t newSize = (*size == 0) ? (STAT_BATCH * 64) : *size;
+        while (*len + n > newSize)
+            newSize *= 2;
+        char *temp = (char *)realloc(*buf, newSize);
+        if (temp == NULL)
+            return -1L;
+        *buf = temp;
+        *size = newSize;
+    }
 
-            /* If is a match, add the file name to results */
-            if ((!(GET_BIT(flags, CONFLICT))) == regex_engine_isMatch(regex, dent->d_name)) {
-                sprintf(buffer, "%s%s", crDir->path, dent->d_name);
-                char *result = strdup(buffer);
-                if (result != NULL) {
-                    if (ts_treeset_add(results, result) != OK)
-                        free(result);
-                }
-            }
-        } else {
-            /*
-             * Ignore all other types of entries
-             */
-            continue;
+    memcpy(*buf + *len, name, n);
+    offset = (long)*len;
+    *len += n;
+    return offset;
+}
+
+/*
+ * Raises the peak '*peak' to 'value' if it's higher.
+ */
+static void raise_peak(atomic_long *peak, long value) {
+
+    long prev = atomic_load(peak);
+    while (value > prev && !atomic_compare_exchange_weak(peak, &prev, value))
+        ;
+}
+
+/*
+ * Adds the directory 'crDir' to the frontier's size if 'add' is set, otherwise removes it.
+ */
+static void frontier_update(CrDir *crDir, int add) {
+
+    long bytes = (long)(sizeof(CrDir) + strlen(crDir->name) + 1);
+
+    if (add) {
+        raise_peak(&peakDirs, atomic_fetch_add(&frontierDirs, 1L) + 1L);
+        raise_peak(&peakBytes, atomic_fetch_add(&frontierBytes, bytes) + bytes);
+    } else {
+        atomic_fetch_sub(&frontierDirs, 1L);
+        atomic_fetch_sub(&frontierBytes, bytes);
+    }
+}
+
+/*
+ * Releases the directory 'crDir' once the worker is done with it, along with the slot
+ * of its device it held in the work queue, if any.
+ */
+static void crawler_dir_done(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    if (crDir->shared)
+        work_queue_done(worker->info->paths, crDir->dev);
+    crawler_dir_free(crDir);
+}
+
+/*
+ * Pushes the directory 'crDir' onto the worker's own deque. Returns 0 if successful,
+ * 1 if the deque could not grow.
+ */
+static int push_directory(struct crawler_worker_t *worker, CrDir *crDir) {
+    return ws_deque_push(worker->deque, crDir) != OK;
+}
+
+/*
+ * Keeps the sub-directory 'crDir' for the worker to crawl itself once it's done with
+ * the directory it's reading, without ever putting it where other threads look for
+ * work. Only done while no thread waits for work, and for at most '--inline-limit'
+ * sub-directories at a time. Returns 0 if kept, 1 if not.
+ */
+static int keep_directory(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    struct crawler_args_t *info = worker->info;
+
+    if (worker->nKept >= info->args->inlineLimit || work_queue_waiting(info->paths) > 0)
+        return 1;
+    /* With per-device limits, a directory must take a slot of its device through its lane */
+    if (info->lanes)
+        return 1;
+    /* Kept directories are crawled newest first, which undoes the inode order unless depth-first */
+    if (info->inodeOrder && info->args->traversal != TRAVERSAL_DFS)
+        return 1;
+    worker->kept[worker->nKept++] = crDir;
+    return 0;
+}
+
+/*
+ * Adds the directories the worker holds in its batch to the work queue, all at once.
+ */
+static void flush_directories(struct crawler_worker_t *worker) {
+    if (queue_size(worker->batch) > 0L)
+        (void)work_queue_addAll(worker->info->paths, worker->node, worker->batch);
+}
+
+/*
+ * Records that the worker got through a directory or entry, so that it is not taken to
+ * be stuck. Only the worker itself writes its progress.
+ */
+static void worker_progress(struct crawler_worker_t *worker) {
+    atomic_store_explicit(&(worker->progress),
+                          atomic_load_explicit(&(worker->progress), memory_order_relaxed) + 1L,
+                          memory_order_relaxed);
+}
+
+/*
+ * Shares the oldest directories of the worker's deque with the threads waiting on the
+ * work queue, one per waiting thread. Threads only wait there once they failed to
+ * steal, so this is how they learn of new work. The oldest are the shallowest, so they
+ * are the most likely to hold large subtrees.
+ */
+static void share_directories(struct crawler_worker_t *worker) {
+
+    int n = work_queue_waiting(worker->info->paths);
+    void *crDir;
+
+    while (n-- > 0 && ws_deque_steal(worker->deque, &crDir) == OK) {
+        if (queue_add(worker->batch, crDir) != OK) {
+            /* It can't be put back at the top, the worker will crawl it next instead */
+            if (ws_deque_push(worker->deque, crDir) != OK)
+                crawler_dir_free(crDir);
+            break;
         }
     }
+    flush_directories(worker);
 }
 
 /*
- * Main method that contains the file crawling logic.
- *
- * This method is passed to the pthread_create method to kickstart off the
- * multi-threaded logic.
+ * Shares the oldest of the directories the worker kept for itself with the threads
+ * waiting on the work queue, one per waiting thread, as no other thread can take them.
  */
-static void *process_dirs(void *arg) {
+static void share_kept(struct crawler_worker_t *worker) {
 
-    struct crawler_args_t *args = (struct crawler_args_t *)arg;
-    int verbose = !(GET_BIT(args->args->progFlags, NO_WARN));
-    CrDir *crDir;
-    DIR *dir;
-    char buffer[BUFFER_SIZE];
+    int n = work_queue_waiting(worker->info->paths), i;
 
-    /* Keep working while the work queue is not empty */
-    while (!work_queue_poll(args->paths, (void **)&crDir)) {
+    if (n > worker->nKept)
+        n = worker->nKept;
+    for (i = 0; i < n; i++) {
+        if (queue_add(worker->batch, worker->kept[i]) != OK)
+            break;
+    }
+    if (i > 0) {
+        worker->nKept -= i;
+        memmove(worker->kept, worker->kept + i, (size_t)worker->nKept * sizeof(CrDir *));
+        flush_directories(worker);
+    }
+}
 
-        /*
-         * Attempt to open the directory. If not successful, print the error and
-         * continue on to the next (most likely due to a permissions issue).
-         */
-        if ((dir = opendir(crDir->path)) == NULL) {
-            if (verbose) {
-                sprintf(buffer, "ERROR: Failed to open directory %s", crDir->path);
-                perror(buffer);
+/*
+ * Steals a directory from the deque of another worker into '*crDir'. The victims are
+ * tried in turn from one picked at random, so that idle threads spread out over the
+ * busy ones. Returns 0 if successful, 1 if there was none to steal.
+ */
+static int steal_directory(struct crawler_worker_t *worker, CrDir **crDir) {
+
+    struct crawler_args_t *info = worker->info;
+    int n = atomic_load_explicit(&(info->nWorkers), memory_order_acquire);
+    int i, start, round;
+    void *item;
+
+    for (round = 0; round < STEAL_ROUNDS && n > 1; round++) {
+        /* xorshift, each thread keeps its own state */
+        worker->seed ^= worker->seed << 13;
+        worker->seed ^= worker->seed >> 17;
+        worker->seed ^= worker->seed << 5;
+        start = (int)(worker->seed % (unsigned int)n);
+        for (i = 0; i < n; i++) {
+            struct crawler_worker_t *victim = &(info->workers[(start + i) % n]);
+            if (victim != worker && ws_deque_steal(victim->deque, &item) == OK) {
+                *crDir = (CrDir *)item;
+                return 0;
             }
-            crawler_dir_free(crDir);
-            continue;
         }
+    }
 
-        /* Process the open directory, then clean up the memory */
-        process_directory(dir, crDir, args);
-        crawler_dir_free(crDir);
-        closedir(dir);
+    return 1;
+}
+
+/*
+ * Takes a batch of directories from the work queue, waiting on it for them, and hands
+ * the first to the worker in '*crDir'. The rest go on the worker's own deque, in the
+ * order they were queued, where other workers can steal them. Returns 0 if successful,
+ * 1 if there were none.
+ */
+static int poll_directories(struct crawler_worker_t *worker, CrDir **crDir) {
+
+    CrDir *polled[POLL_BATCH];
+    void *item;
+    int n = 0;
+
+    if (work_queue_pollAll(worker->info->paths, worker->node, worker->batch, POLL_BATCH) != 0)
+        return 1;
+    while (queue_poll(worker->batch, &item) == OK) {
+        /* With per-device limits, the directory holds a slot of its device until it's done */
+        if (worker->info->lanes)
+            ((CrDir *)item)->shared = 1;
+        polled[n++] = (CrDir *)item;
+    }
+    *crDir = polled[0];
+    /* The deque gives back its newest first, so the last queued goes in first */
+    while (--n > 0) {
+        if (push_directory(worker, polled[n]) != 0 &&
+            work_queue_addTo(worker->info->paths, worker->node, polled[n]) != OK) {
+            if (trackFrontier && polled[n]->parent != NULL)
+                frontier_update(polled[n], 0);
+            crawler_dir_done(worker, polled[n]);
+        }
     }
 
-    return NULL;
+    return 0;
 }
 
-void process(RegexEngine *regex, ConcurrentTreeSet *results, WorkQueue *paths, ProgArgs *progArgs) {
+/*
+ * Fetches the next directory for the worker to crawl into '*crDir': the newest it kept
+ * for itself, otherwise the newest on its own deque, otherwise one stolen from another
+ * worker's deque, or otherwise the next in the work queue. The worker waits on the work
+ * queue if 'wait' is set; as only idle threads touch the work queue then, the crawl
+ * ends once they all wait on it. Returns 0 if successful, 1 if there was none.
+ */
+static int next_directory(struct crawler_worker_t *worker, CrDir **crDir, int wait) {
 
-    struct crawler_args_t args = { regex, results, paths, progArgs };
-    pthread_t threads[progArgs->nThreads];
-    int i;
+    int status;
+    void *item;
 
-    /* Creates the threads for kickoff, then wait for all to complete */
-    for (i = 0; i < progArgs->nThreads; i++) {
-        (void)pthread_create(&(threads[i]), NULL, process_dirs, &args);
+    /* Nothing may be held back from the other threads while this one waits */
+    flush_directories(worker);
+    if (worker->nKept > 0) {
+        *crDir = worker->kept[--worker->nKept];
+        share_kept(worker);
+        status = 0;
+    } else if (ws_deque_take(worker->deque, &item) == OK) {
+        *crDir = (CrDir *)item;
+        share_directories(worker);
+        status = 0;
+    } else {
+        status = steal_directory(worker, crDir);
+    }
+    if (status != 0) {
+        /* Threads started in place of stuck ones retire once they run out of work */
+        if (wait && worker->index >= atomic_load_explicit(&(worker->info->keepWorkers), memory_order_relaxed)) {
+            work_queue_leave(worker->info->paths);
+            worker->retiring = 1;
+            return 1;
+        }
+        if (wait) {
+            atomic_store_explicit(&(worker->idle), 1, memory_order_relaxed);
+            status = poll_directories(worker, crDir);
+            atomic_store_explicit(&(worker->idle), 0, memory_order_relaxed);
+        } else {
+            status = work_queue_tryPollFrom(worker->info->paths, worker->node, (void **)crDir);
+            /* With per-device limits, the directory holds a slot of its device until it's done */
+            if (status == 0 && worker->info->lanes)
+                (*crDir)->shared = 1;
+        }
+    }
+
+    if (status == 0)
+        worker_progress(worker);
+    /* The search paths were never counted in the frontier */
+    if (status == 0 && trackFrontier && (*crDir)->parent != NULL)
+        frontier_update(*crDir, 0);
+    return status;
+}
+
+/*
+ * The fixed part of a spilled directory's record, followed by its name.
+ */
+struct spill_record_t {
+    CrDir *parent;                  /* The parent, whose reference is held by the record */
+    int32_t maxDepth;               /* The directory's max depth */
+    int32_t minDepth;               /* The directory's min depth */
+    uint64_t dev;                   /* The device it's on */
+    uint64_t mntId;                 /* The mount it's on */
+    uint64_t rootDev;               /* The device of the search path it was found under */
+};
+
+/*
+ * Writes the directory 'item' out as a record for the work queue's spill file, then
+ * releases it. The reference it holds on its parent is handed to the record, so the
+ * directory comes back under the same parent: it is reopened relative to it like any
+ * other, and its cost still counts toward the parent's subtree.
+ */
+static size_t spill_directory(void *item, char *buffer, size_t size) {
+
+    CrDir *crDir = (CrDir *)item;
+    struct spill_record_t record;
+    size_t len = strlen(crDir->name);
+
+    /* Requests to help read a directory only make sense while it's open */
+    if (crDir->split || sizeof(record) + len > size)
+        return 0;
+
+    record.parent = crDir->parent;
+    record.maxDepth = crDir->maxDepth;
+    record.minDepth = crDir->minDepth;
+    record.dev = crDir->dev;
+    record.mntId = crDir->mntId;
+    record.rootDev = crDir->rootDev;
+    memcpy(buffer, &record, sizeof(record));
+    memcpy(buffer + sizeof(record), crDir->name, len);
+
+    /* The directory no longer holds any memory */
+    if (trackFrontier && crDir->parent != NULL)
+        frontier_update(crDir, 0);
+    if (crDir->parent != NULL)
+        atomic_fetch_add(&(crDir->parent->refs), 1);
+    crawler_dir_free(crDir);
+
+    return sizeof(record) + len;
+}
+
+/*
+ * Recreates a directory from its record in the work queue's spill file.
+ */
+static void *unspill_directory(const char *buffer, size_t len) {
+
+    struct spill_record_t record;
+    char name[PATH_MAX];
+    CrDir *crDir;
+
+    if (len < sizeof(record) || len - sizeof(record) >= PATH_MAX)
+        return NULL;
+
+    memcpy(&record, buffer, sizeof(record));
+    memcpy(name, buffer + sizeof(record), len - sizeof(record));
+    name[len - sizeof(record)] = '\0';
+    if ((crDir = crawler_dir_malloc(record.parent, name, record.maxDepth, record.minDepth)) != NULL) {
+        crDir->dev = record.dev;
+        crDir->mntId = record.mntId;
+        crDir->rootDev = record.rootDev;
+        if (trackFrontier && crDir->parent != NULL)
+            frontier_update(crDir, 1);
     }
-    for (i = 0; i < progArgs->nThreads; i++) {
-        (void)pthread_join(threads[i], NULL);
+    /* The new directory holds a reference of its own, the record's is released */
+    crawler_dir_free(record.parent);
+
+    return crDir;
+}
+
+/*
+ * Adds the sub-directory 'name' of 'crDir' to the directories to crawl, given the device
+ * and the mount it's on. Depending on the traversal, it is either shared through the
+ * work queue or kept on the worker's own stack.
+ */
+static void queue_directory(struct crawler_worker_t *worker, CrDir *crDir, const char *name,
+                            uint64_t dev, uint64_t mntId) {
+
+    struct crawler_args_t *info = worker->info;
+    int verbose = !(GET_BIT(info->args->progFlags, NO_WARN));
+    CrDir *newDir = crawler_dir_malloc(crDir, name, (crDir->maxDepth - 1), (crDir->minDepth - 1));
+    Traversal traversal = info->args->traversal;
+    const char *path;
+    long frontier;
+
+    if (newDir != NULL) {
+        newDir->dev = dev;
+        newDir->mntId = mntId;
+        if (trackFrontier)
+            frontier_update(newDir, 1);
+        /* A directory that took long on a past crawl goes straight to the work queue */
+        if (history != NULL && (path = crawler_dir_path(worker, crDir)) != NULL &&
+            (newDir->cost = cost_history_find(history, path, name)) > 0L &&
+            work_queue_addTo(info->paths, worker->node, newDir) == OK)
+            return;
+        /* Most directories are small, the worker crawls them itself rather than share them */
+        if (keep_directory(worker, newDir) == 0)
+            return;
+        /*
+         * Depth-first, or hybrid past the frontier limit, the worker keeps the directory.
+         * Past twice the limit, hybrid hands it to the work queue instead, which spills
+         * it to disk, so the frontier held in memory stays bounded. With per-device
+         * limits, it always goes through its lane.
+         */
+        frontier = (traversal == TRAVERSAL_HYBRID) ? atomic_load(&frontierDirs) : 0L;
+        if (!info->lanes && (traversal == TRAVERSAL_DFS ||
+                             (frontier > info->args->frontierLimit && frontier <= 2 * info->args->frontierLimit)) &&
+            push_directory(worker, newDir) == 0)
+            return;
+        /* Otherwise it's batched with its siblings, to be added to the work queue together */
+        if (queue_add(worker->batch, newDir) == OK) {
+            if (queue_size(worker->batch) >= ADD_BATCH)
+                flush_directories(worker);
+        } else if (work_queue_addTo(info->paths, worker->node, newDir) != OK) {
+            if (trackFrontier)
+                frontier_update(newDir, 0);
+            crawler_dir_free(newDir);
+            LOG("Failed to allocate enough memory from the heap, skipping directory: %s%s/\n",
+                crawler_dir_path(worker, crDir), name);
+        }
+    } else {
+        LOG("Failed to allocate enough memory from the heap, skipping directory: %s%s/\n",
+            crawler_dir_path(worker, crDir), name);
+    }
+}
+
+/*
+ * Holds the sub-directory 'name' of 'crDir' back until the whole directory has been
+ * read, so it can be queued in inode order. Queues it right away if it cannot be held.
+ */
+static void hold_directory(struct crawler_worker_t *worker, CrDir *crDir, const char *name, uint64_t ino,
+                           uint64_t dev, uint64_t mntId) {
+
+    long offset;
+
+    if (worker->nHeld == worker->heldSize) {
+        int size = (worker->heldSize == 0) ? STAT_BATCH : 2 * worker->heldSize;
+        struct held_dir_t *temp = (struct held_dir_t *)realloc(worker->held, size * sizeof(struct held_dir_t));
+        if (temp == NULL) {
+            queue_directory(worker, crDir, name, dev, mntId);
+            return;
+        }
+        worker->held = temp;
+        worker->heldSize = size;
+    }
+    if ((offset = append_name(&(worker->heldNames), &(worker->heldNamesSize), &(worker->heldNamesLen), name)) < 0L) {
+        queue_directory(worker, crDir, name, dev, mntId);
+        return;
+    }
+
+    worker->held[worker->nHeld].ino = ino;
+    worker->held[worker->nHeld].name = (size_t)offset;
+    worker->held[worker->nHeld].dev = dev;
+    worker->held[worker->nHeld].mntId = mntId;
+    worker->nHeld++;
+}
+
+/*
+ * Used to sort the held sub-directories by their inode numbers.
+ */
+static int compare_inodes(const void *a, const void *b) {
+
+    uint64_t x = ((const struct held_dir_t *)a)->ino, y = ((const struct held_dir_t *)b)->ino;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Queues all the sub-directories of 'crDir' held back, in inode order. On most
+ * filesystems, inode order follows the on-disk layout, so the directories are
+ * then opened with short seeks rather than in the random order 'getdents()' gives.
+ */
+static void queue_held(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    int i;
+
+    if (worker->nHeld == 0)
+        return;
+
+    qsort(worker->held, worker->nHeld, sizeof(struct held_dir_t), compare_inodes);
+    for (i = 0; i < worker->nHeld; i++) {
+        /* Depth-first, the directories are stacked, so they are pushed in reverse */
+        int j = (worker->info->args->traversal == TRAVERSAL_DFS) ? (worker->nHeld - 1 - i) : i;
+        struct held_dir_t *dir = &(worker->held[j]);
+        queue_directory(worker, crDir, worker->heldNames + dir->name, dir->dev, dir->mntId);
+    }
+
+    worker->nHeld = 0;
+    worker->heldNamesLen = 0;
+}
+
+/*
+ * Processes the entry 'name' of type 'type' and inode number 'ino' inside the directory
+ * 'crDir'. If the entry had to be resolved with 'statx()', the result is passed in 'stx',
+ * otherwise it's NULL.
+ *
+ *   If a directory is found, add it to the work queue
+ *   If a regular file is found, attempt to match against a regex
+ */
+static void process_entry(struct crawler_worker_t *worker, CrDir *crDir, const char *name, unsigned char type,
+                          uint64_t ino, const struct statx *stx) {
+
+    struct crawler_args_t *info = worker->info;
+    unsigned int flags = info->args->progFlags;
+    int maxDepth = crDir->maxDepth;
+    int minDepth = crDir->minDepth;
+    uint64_t dev = crDir->dev, mntId = crDir->mntId;
+
+    worker_progress(worker);
+
+    /* If entry is a directory, add it to list of paths to search */
+    if (type == DT_DIR) {
+
+        /* Pruned directories are neither crawled nor matched */
+        if (stx != NULL && worker->pruneMatch != NULL && regex_context_isMatch(worker->pruneMatch, name))
+            return;
+
+        /* A resolved sub-directory may be on a mount of its own, its device is taken as is */
+        if (stx != NULL)
+            dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+
+        /* If maximum depth has not been reached, add directory to work queue */
+        /* Sub-directories on excluded mounts are never queued */
+        if (maxDepth != 0 && (!info->mountAware || stx == NULL || check_mount(info, crDir, stx, &dev, &mntId))) {
+            if (info->inodeOrder)
+                hold_directory(worker, crDir, name, ino, dev, mntId);
+            else
+                queue_directory(worker, crDir, name, dev, mntId);
+        }
+
+        /* Checks the directory name against the regex */
+        /* Do so if -F flag is on and minimum depth has been reached */
+        if (GET_BIT(flags, CHECK_FOLDERS) && minDepth <= 0) {
+            /* If is a match, add the name to results */
+            if ((!(GET_BIT(flags, CONFLICT))) == regex_context_isMatch(worker->match, name))
+                add_result(worker, crDir, name);
+        }
+
+    }
+
+    /* If entry is a normal file, check the name against the regex */
+    else if (type == DT_REG) {
+
+        /* Skip if the minimum depth has not been reached */
+        if (minDepth > 0)
+            return;
+
+        /* If is a match, add the file name to results */
+        if ((!(GET_BIT(flags, CONFLICT))) == regex_context_isMatch(worker->match, name))
+            add_result(worker, crDir, name);
+    }
+
+    /*
+     * Ignore all other types of entries
+     */
+}
+
+/*
+ * Resolves the types of all the entries waiting in the worker's batch with 'statx()',
+ * requesting nothing but the file type, then processes each of them. With the
+ * io_uring engine, the whole batch is submitted to the kernel with a single call.
+ */
+static void resolve_entries(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    int results[STAT_BATCH];
+    int i, n = worker->nPending, queued = 0, status, res;
+    void *data;
+
+    if (n == 0)
+        return;
+
+    /* Positive results mark the entries that are still unresolved */
+    for (i = 0; i < n; i++)
+        results[i] = 1;
+
+    if (worker->statRing != NULL) {
+        for (i = 0; i < n; i++) {
+            if (uring_prep_statx(worker->statRing, worker->fd, worker->names + worker->pending[i],
+                                 worker->info->statFlags, worker->info->statMask, &(worker->stats[i]),
+                                 (void *)(long)i) != 0)
+                break;
+            queued++;
+        }
+        status = (queued > 0) ? uring_submit(worker->statRing, (unsigned)queued) : 0;
+        if (status == EAGAIN || status == EBUSY)
+            status = 0;
+        while (status == 0 && queued > 0) {
+            if (uring_complete(worker->statRing, &data, &res) == 0) {
+                results[(long)data] = res;
+                queued--;
+            } else if ((status = uring_submit(worker->statRing, 1)) == EAGAIN || status == EBUSY) {
+                status = 0;
+            }
+        }
+        if (status != 0) {
+            /*
+             * The ring is given up on, the remaining entries are resolved with blocking calls.
+             * Destroying it first waits out the statx calls still writing into the buffers.
+             */
+            uring_destroy(worker->statRing);
+            worker->statRing = NULL;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        if (results[i] > 0)
+            results[i] = statx(worker->fd, worker->names + worker->pending[i], worker->info->statFlags,
+                               worker->info->statMask, &(worker->stats[i]));
+    }
+
+    for (i = 0; i < n; i++) {
+        /* The entry may have been removed since it was read, if so it is skipped */
+        if (results[i] != 0 || !(worker->stats[i].stx_mask & STATX_TYPE))
+            continue;
+        process_entry(worker, crDir, worker->names + worker->pending[i], IFTODT(worker->stats[i].stx_mode),
+                      worker->stats[i].stx_ino, &(worker->stats[i]));
+    }
+
+    worker->nPending = 0;
+    worker->namesLen = 0;
+}
+
+/*
+ * Adds the entry 'name' to the worker's batch of entries to resolve: its type was not
+ * reported by the filesystem (DT_UNKNOWN), it is a symbolic link to follow, or it is
+ * a sub-directory whose mount or device has to be checked. Resolves the batch once it
+ * is full.
+ */
+static void defer_entry(struct crawler_worker_t *worker, CrDir *crDir, const char *name) {
+
+    struct statx stx;
+    long offset;
+
+    /* Names have to be copied out, since the reader's buffer is reused */
+    if ((offset = append_name(&(worker->names), &(worker->namesSize), &(worker->namesLen), name)) < 0L) {
+        /* Resolves the entry on its own instead */
+        if (statx(worker->fd, name, worker->info->statFlags, worker->info->statMask, &stx) == 0 &&
+            (stx.stx_mask & STATX_TYPE))
+            process_entry(worker, crDir, name, IFTODT(stx.stx_mode), stx.stx_ino, &stx);
+        return;
+    }
+
+    worker->pending[worker->nPending++] = (size_t)offset;
+    if (worker->nPending == STAT_BATCH)
+        resolve_entries(worker, crDir);
+}
+
+/*
+ * Asks threads waiting on the work queue to help read the directory 'crDir', one
+ * request per waiting thread and no more than 'max'. Returns the number of requests.
+ */
+static int split_directory(struct crawler_worker_t *worker, CrDir *crDir, int max) {
+
+    WorkQueue *paths = worker->info->paths;
+    int n = work_queue_waiting(paths), added = 0;
+    CrDir *helper;
+
+    while (added < n && added < max) {
+        if ((helper = crawler_dir_malloc(crDir, "", crDir->maxDepth, crDir->minDepth)) == NULL)
+            break;
+        helper->split = 1;
+        if (trackFrontier)
+            frontier_update(helper, 1);
+        if (work_queue_addTo(paths, worker->node, helper) != OK) {
+            if (trackFrontier)
+                frontier_update(helper, 0);
+            crawler_dir_free(helper);
+            break;
+        }
+        added++;
+    }
+
+    return added;
+}
+
+/*
+ * Prcoesses all the files in the directory currently opened in the worker's reader.
+ *
+ * Will iterate through all entries in the directory. Entries of unknown type, symbolic
+ * links when following them, and sub-directories when checking mounts are collected
+ * and resolved in batches before being processed.
+ *
+ * If 'split' is set and the directory turns out to be large, idle threads are asked
+ * to help read it. The kernel hands each 'getdents64()' call on the shared descriptor
+ * the next chunk of entries, so the threads never see the same entry twice.
+ */
+static void process_directory(struct crawler_worker_t *worker, CrDir *crDir, int split) {
+
+    DirReader *reader = worker->reader;
+    unsigned int flags = worker->info->args->progFlags;
+    DirEntry *dent;
+    int verbose = !(GET_BIT(flags, NO_WARN));
+    int follow = GET_BIT(flags, FOLLOW_LINKS);
+    int checkMounts = (worker->info->mountAware || worker->info->lanes) && crDir->maxDepth != 0;
+    RegexContext *prune = worker->pruneMatch;
+    long splitAfter = worker->info->args->splitAfter;
+    long nEntries = 0L, nextCheck = (split && splitAfter > 0L) ? splitAfter : -1L;
+    int helpers = 0, maxHelpers = worker->info->args->nThreads - 1;
+    struct timespec start, end;
+
+    if (history != NULL)
+        (void)clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while ((dent = dir_reader_next(reader)) != NULL) {
+
+        /* Past the threshold, checks for idle threads every so often */
+        if (++nEntries == nextCheck) {
+            helpers += split_directory(worker, crDir, maxHelpers - helpers);
+            nextCheck = (helpers < maxHelpers) ? (nextCheck + SPLIT_CHECK) : -1L;
+        }
+
+        /* Entries starting with '.' are either the current/parent directory or hidden */
+        if (dent->d_name[0] == '.') {
+            /* Ignore current working directory and parent directory */
+            if (dent->d_name[1] == '\0' || (dent->d_name[1] == '.' && dent->d_name[2] == '\0'))
+                continue;
+            /* Ignore files & directories starting with '.' if --all is not specified */
+            if (!GET_BIT(flags, SHOW_ALL))
+                continue;
+        }
+
+        /* Pruned directories are dropped before anything is allocated or looked up for them */
+        if (dent->d_type == DT_DIR && prune != NULL && regex_context_isMatch(prune, dent->d_name))
+            continue;
+
+        if (dent->d_type == DT_UNKNOWN || (dent->d_type == DT_LNK && follow) || (dent->d_type == DT_DIR && checkMounts))
+            defer_entry(worker, crDir, dent->d_name);
+        else
+            process_entry(worker, crDir, dent->d_name, dent->d_type, dent->d_ino, NULL);
+    }
+    resolve_entries(worker, crDir);
+    queue_held(worker, crDir);
+
+    /* Each thread reading the directory adds the time it spent to the directory's cost */
+    if (history != NULL) {
+        (void)clock_gettime(CLOCK_MONOTONIC, &end);
+        atomic_fetch_add(&(crDir->nanos), (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec));
+        atomic_fetch_add(&(crDir->entries), nEntries);
+    }
+
+    if (dir_reader_error(reader) != 0) {
+        LOG("ERROR: Failed to read directory %s: %s\n", crawler_dir_path(worker, crDir),
+            strerror(dir_reader_error(reader)));
+    }
+}
+
+/*
+ * Prints the error for the directory 'crDir' failing to open with the errno 'err'.
+ */
+static void report_open_error(struct crawler_worker_t *worker, CrDir *crDir, int err) {
+
+    const char *path = crawler_dir_path(worker, crDir);
+    fprintf(stderr, "ERROR: Failed to open directory %s: %s\n", (path != NULL) ? path : crDir->name, strerror(err));
+}
+
+/*
+ * Stops reading the entries of 'crDir'. The last thread to stop closes the descriptor
+ * they were read from, unless it's kept open for the children.
+ */
+static void finish_reading(CrDir *crDir) {
+
+    if (atomic_fetch_sub(&(crDir->readers), 1) == 1 && crDir->fd != crDir->readFd)
+        close(crDir->readFd);
+}
+
+/*
+ * Crawls the directory 'crDir' that has been opened as 'fd', then releases both.
+ */
+static void crawl_directory(struct crawler_worker_t *worker, CrDir *crDir, int fd) {
+
+    struct stat sb;
+    int verbose = !(GET_BIT(worker->info->args->progFlags, NO_WARN));
+
+    /* The search paths set the device and mount their sub-directories are checked against */
+    if ((worker->info->mountAware || worker->info->lanes) && crDir->parent == NULL && crDir->rootDev == 0) {
+        struct statx stx;
+        if (statx(fd, "", AT_EMPTY_PATH|AT_STATX_DONT_SYNC, STATX_TYPE|STATX_MNT_ID, &stx) == 0) {
+            /* Its slot was taken under the device it was queued with, which wasn't known yet */
+            if (crDir->shared) {
+                work_queue_done(worker->info->paths, crDir->dev);
+                crDir->shared = 0;
+            }
+            crDir->dev = crDir->rootDev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            crDir->mntId = (stx.stx_mask & STATX_MNT_ID) ? stx.stx_mnt_id : 0;
+        }
+    }
+
+    /*
+     * When following links, the same directory can be reached through many paths, and
+     * a link can point back at one of its own ancestors. Each directory is only crawled
+     * by whichever thread records its (device, inode) pair first.
+     */
+    if (worker->info->visited != NULL) {
+        Status status = (fstat(fd, &sb) == 0)
+            ? inode_set_add(worker->info->visited, (uint64_t)sb.st_dev, (uint64_t)sb.st_ino)
+            : ALLOC_FAILURE;
+        if (status != OK) {
+            if (status != ALREADY_EXISTS)
+                LOG("Failed to record the directory as visited, skipping directory: %s\n",
+                    crawler_dir_path(worker, crDir));
+            close(fd);
+            crawler_dir_done(worker, crDir);
+            return;
+        }
+    }
+
+    /*
+     * Keeps the descriptor open for the children to open themselves relative to,
+     * as long as the budget allows. This must be decided before any children are
+     * queued, since other threads may start reading it right away.
+     */
+    if (atomic_fetch_add(&retainedFds, 1L) < fdBudget)
+        crDir->fd = fd;
+    else
+        atomic_fetch_sub(&retainedFds, 1L);
+
+    /*
+     * In inode order, the directory is most likely cold in the cache; hints the kernel to
+     * start reading all of it in rather than block by block as it's read
+     */
+    if (worker->info->inodeOrder)
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+
+    /* Process the open directory, then clean up the memory */
+    atomic_fetch_add_explicit(&(worker->nDirs), 1L, memory_order_relaxed);
+    worker->fd = fd;
+    crDir->readFd = fd;
+    atomic_store(&(crDir->readers), 1);
+    dir_reader_open(worker->reader, fd);
+    process_directory(worker, crDir, 1);
+    finish_reading(crDir);
+    crawler_dir_done(worker, crDir);
+}
+
+/*
+ * Helps read the directory requested by 'helper', if it's still being read, then
+ * releases the request.
+ */
+static void help_directory(struct crawler_worker_t *worker, CrDir *helper) {
+
+    CrDir *crDir = helper->parent;
+    int readers = atomic_load(&(crDir->readers));
+
+    /* Joins in only while at least one thread is still reading */
+    while (readers > 0 && !atomic_compare_exchange_weak(&(crDir->readers), &readers, readers + 1))
+        ;
+    if (readers > 0) {
+        worker->fd = crDir->readFd;
+        dir_reader_open(worker->reader, crDir->readFd);
+        process_directory(worker, crDir, 0);
+        finish_reading(crDir);
+    }
+
+    crawler_dir_done(worker, helper);
+}
+
+/*
+ * Opens the directory 'crDir' with a blocking call, then crawls it.
+ */
+static void open_directory(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    int verbose = !(GET_BIT(worker->info->args->progFlags, NO_WARN));
+    int fd;
+
+    /* Requests to help read a directory are served on the spot, it's already open */
+    if (crDir->split) {
+        help_directory(worker, crDir);
+        return;
+    }
+
+    /*
+     * Attempt to open the directory. If not successful, print the error and
+     * continue on to the next (most likely due to a permissions issue).
+     */
+    if ((fd = crawler_dir_open(crDir, worker->info->openFlags)) < 0) {
+        if (verbose)
+            report_open_error(worker, crDir, errno);
+        crawler_dir_done(worker, crDir);
+        return;
+    }
+
+    crawl_directory(worker, crDir, fd);
+}
+
+/*
+ * Main method that contains the file crawling logic.
+ *
+ * This method is passed to the pthread_create method to kickstart off the
+ * multi-threaded logic.
+ */
+static void *process_dirs(void *arg) {
+
+    struct crawler_worker_t *worker = (struct crawler_worker_t *)arg;
+    CrDir *crDir;
+
+    /* Keep working while the work queue is not empty */
+    while (!next_directory(worker, &crDir, 1))
+        open_directory(worker, crDir);
+
+    return NULL;
+}
+
+/*
+ * Queues the open of the directory 'crDir' on the worker's ring. If the directory
+ * cannot be opened relative to an open descriptor, or is a request to help read a
+ * directory, it is handled right away instead. Returns 0 if the open was queued, 1 if it was handled in place.
+ */
+static int open_directory_async(struct crawler_worker_t *worker, CrDir *crDir) {
+
+    int dfd, flags = OPEN_FLAGS;
+
+    if (crDir->split) {
+        help_directory(worker, crDir);
+        return 1;
+    }
+
+    if (crDir->parent == NULL) {
+        dfd = AT_FDCWD;
+    } else if ((dfd = crDir->parent->fd) >= 0) {
+        flags = worker->info->openFlags;
+    } else {
+        /* Parent was not kept open, its chain has to be reopened first */
+        open_directory(worker, crDir);
+        return 1;
+    }
+
+    if (uring_prep_openat(worker->ring, dfd, crDir->name, flags, crDir) != 0) {
+        open_directory(worker, crDir);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Crawls the directory 'crDir' once its open on the worker's ring has completed with
+ * 'res', the descriptor, or otherwise the negated errno.
+ */
+static void finish_open(struct crawler_worker_t *worker, CrDir *crDir, int res) {
+
+    if (res < 0) {
+        if (!(GET_BIT(worker->info->args->progFlags, NO_WARN)))
+            report_open_error(worker, crDir, -res);
+        crawler_dir_done(worker, crDir);
+    } else {
+        crawl_directory(worker, crDir, res);
+    }
+}
+
+/*
+ * Gives up on the worker's ring after a submission failed with 'err', with 'inflight'
+ * opens still on it. The opens the kernel never took are taken back and done with
+ * blocking calls, and those it took are waited out and crawled, so no directory is lost
+ * unless the ring cannot even be waited on. The worker then carries on with the sync
+ * engine.
+ */
+static void abandon_ring(struct crawler_worker_t *worker, int err, int inflight) {
+
+    static atomic_int reported;
+    void *data;
+    int res;
+
+    if (!(GET_BIT(worker->info->args->progFlags, NO_WARN)) && atomic_exchange(&reported, 1) == 0)
+        fprintf(stderr, "WARNING: Failed to submit to io_uring (%s), falling back to the sync engine.\n",
+                strerror(err));
+
+    while (inflight > 0 && uring_reclaim(worker->ring, &data) == 0) {
+        inflight--;
+        open_directory(worker, (CrDir *)data);
+    }
+    while (inflight > 0) {
+        if (uring_complete(worker->ring, &data, &res) == 0) {
+            worker_progress(worker);
+            inflight--;
+            finish_open(worker, (CrDir *)data, res);
+        } else if ((err = uring_submit(worker->ring, 1)) != 0 && err != EAGAIN && err != EBUSY) {
+            break;
+        }
+    }
+
+    uring_destroy(worker->ring);
+    worker->ring = NULL;
+}
+
+/*
+ * File crawling logic for the io_uring engine.
+ *
+ * Rather than blocking on each open, the thread keeps up to '--io-depth' directory
+ * opens in flight on its ring, and crawls each directory as soon as its open completes.
+ * There is no io_uring operation for reading directory entries, so each directory is
+ * still read with 'getdents64()' once it is open.
+ */
+static void *process_dirs_uring(void *arg) {
+
+    struct crawler_worker_t *worker = (struct crawler_worker_t *)arg;
+    int depth = worker->info->args->ioDepth;
+    int inflight = 0, status, res;
+    CrDir *crDir;
+    void *data;
+
+    for (;;) {
+
+        /*
+         * Tops up the ring with more directories. The thread only waits on the work
+         * queue when it has nothing in flight; otherwise it takes what is available.
+         */
+        while (inflight < depth) {
+            if (next_directory(worker, &crDir, inflight == 0) != 0)
+                break;
+            if (open_directory_async(worker, crDir) == 0)
+                inflight++;
+        }
+        /* Work queue is drained and all threads are waiting */
+        if (inflight == 0)
+            break;
+
+        /* Submits the queued opens and waits for at least one to complete */
+        if ((status = uring_submit(worker->ring, 1)) != 0 && status != EAGAIN && status != EBUSY) {
+            abandon_ring(worker, status, inflight);
+            break;
+        }
+        while (uring_complete(worker->ring, &data, &res) == 0) {
+            worker_progress(worker);
+            inflight--;
+            finish_open(worker, (CrDir *)data, res);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Initializes the worker 'worker' to crawl with the shared state 'args', with the sync
+ * engine. When pinning, the 'index'th worker is pinned to the next CPU in turn. Returns
+ * 0 if successful, 1 if allocation failed.
+ */
+static int worker_init(struct crawler_worker_t *worker, struct crawler_args_t *args, int index) {
+
+    worker->info = args;
+    worker->ring = NULL;
+    worker->statRing = NULL;
+    worker->fd = -1;
+    worker->names = NULL;
+    worker->namesSize = 0;
+    worker->namesLen = 0;
+    worker->nPending = 0;
+    worker->held = NULL;
+    worker->nHeld = 0;
+    worker->heldSize = 0;
+    worker->heldNames = NULL;
+    worker->heldNamesSize = 0;
+    worker->heldNamesLen = 0;
+    worker->match = NULL;
+    worker->pruneMatch = NULL;
+    worker->kept = NULL;
+    worker->nKept = 0;
+    worker->deque = NULL;
+    worker->batch = NULL;
+    worker->seed = 2463534242U + (unsigned int)index;
+    worker->index = index;
+    worker->retiring = 0;
+    atomic_init(&(worker->retired), 0);
+    worker->started = 0;
+    atomic_init(&(worker->nDirs), 0L);
+    atomic_init(&(worker->progress), 0L);
+    atomic_init(&(worker->idle), 0);
+    worker->path = NULL;
+    worker->pathSize = 0;
+    worker->pathLen = 0L;
+    worker->pathDir = NULL;
+    worker->nFound = 0;
+    worker->cpu = worker->node = -1;
+    if (args->cpus != NULL) {
+        worker->cpu = args->cpus[index % args->nCpus].cpu;
+        worker->node = args->cpus[index % args->nCpus].node;
+    }
+
+    /* Even breadth-first, the directories taken from the work queue in a batch go in the deque */
+    if (ws_deque_new(&(worker->deque)) != OK)
+        return 1;
+    if (queue_new(&(worker->batch)) != OK) {
+        ws_deque_destroy(worker->deque, NULL);
+        return 1;
+    }
+    if ((worker->reader = dir_reader_new(args->args->dirBufferSize)) == NULL) {
+        queue_destroy(worker->batch, NULL);
+        ws_deque_destroy(worker->deque, NULL);
+        return 1;
+    }
+    if (args->args->inlineLimit > 0 &&
+        (worker->kept = (CrDir **)malloc((size_t)args->args->inlineLimit * sizeof(CrDir *))) == NULL) {
+        dir_reader_destroy(worker->reader);
+        queue_destroy(worker->batch, NULL);
+        ws_deque_destroy(worker->deque, NULL);
+        return 1;
+    }
+    /* Each thread matches through its own context, so matching is never serialized */
+    if ((worker->match = regex_context_new(args->regex)) == NULL ||
+        (args->prune != NULL && (worker->pruneMatch = regex_context_new(args->prune)) == NULL)) {
+        regex_context_destroy(worker->match);
+        free(worker->kept);
+        dir_reader_destroy(worker->reader);
+        queue_destroy(worker->batch, NULL);
+        ws_deque_destroy(worker->deque, NULL);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Releases all the memory held by the worker 'worker'.
+ */
+static void worker_release(struct crawler_worker_t *worker) {
+    while (worker->nFound > 0)
+        free(worker->found[--worker->nFound]);
+    dir_reader_destroy(worker->reader);
+    uring_destroy(worker->ring);
+    uring_destroy(worker->statRing);
+    free(worker->names);
+    free(worker->held);
+    free(worker->heldNames);
+    while (worker->nKept > 0)
+        crawler_dir_free(worker->kept[--worker->nKept]);
+    free(worker->kept);
+    regex_context_destroy(worker->match);
+    regex_context_destroy(worker->pruneMatch);
+    ws_deque_destroy(worker->deque, (void *)crawler_dir_free);
+    queue_destroy(worker->batch, (void *)crawler_dir_free);
+    if (worker->pathDir != NULL)
+        crawler_dir_free(worker->pathDir);
+    free(worker->path);
+}
+
+/*
+ * Runs the worker 'arg' with its engine, then signals that it's finished.
+ */
+static void *run_worker(void *arg) {
+
+    struct crawler_worker_t *worker = (struct crawler_worker_t *)arg;
+
+    if (worker->ring != NULL)
+        (void)process_dirs_uring(worker);
+    /* A worker whose ring failed mid-crawl finishes with the sync engine */
+    if (worker->ring == NULL)
+        (void)process_dirs(worker);
+    flush_results(worker);
+
+    (void)pthread_mutex_lock(&runLock);
+    running--;
+    (void)pthread_cond_signal(&runCond);
+    (void)pthread_mutex_unlock(&runLock);
+    if (worker->retiring)
+        atomic_store_explicit(&(worker->retired), 1, memory_order_release);
+
+    return NULL;
+}
+
+/*
+ * Creates the thread of the worker 'worker' to run 'routine', pinned to the worker's
+ * CPU if it has one. The thread starts out on that CPU, so the memory it first touches
+ * is on its node. Returns 0 if successful, otherwise the error from 'pthread_create()'.
+ */
+static int create_thread(struct crawler_worker_t *worker, void *(*routine)(void *)) {
+
+    pthread_attr_t attr;
+    cpu_set_t set;
+    int status;
+
+    if (worker->cpu < 0)
+        return pthread_create(&(worker->thread), NULL, routine, worker);
+
+    (void)pthread_attr_init(&attr);
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    (void)pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    status = pthread_create(&(worker->thread), &attr, routine, worker);
+    (void)pthread_attr_destroy(&attr);
+
+    return status;
+}
+
+/*
+ * State of the tuning of the thread count with '-X auto'.
+ */
+struct tuner_t {
+    int threads;                    /* The count being measured */
+    int settled;                    /* The last count that paid off */
+    long before;                    /* Directories crawled per interval at the settled count */
+    int direction;                  /* The way the next count is tried, 1 or -1 */
+    int steady;                     /* Number of measures since the count last changed */
+};
+
+/*
+ * Tunes the number of threads working at once, given that 'rate' directories were
+ * crawled in the last interval. Once steady, another count is tried; the tuning keeps
+ * moving that way while the rate improves, and otherwise goes back and settles again.
+ * More threads are only tried while the queue has work waiting for them. Returns the
+ * new count.
+ */
+static int tune_threads(struct tuner_t *tuner, WorkQueue *paths, int maxThreads, long rate) {
+
+    int step, next;
+
+    if (tuner->threads != tuner->settled) {
+        /* Trying a new count: keep going while it pays off, otherwise go back */
+        if (rate <= tuner->before + (long)(tuner->before * TUNE_MARGIN)) {
+            tuner->threads = tuner->settled;
+            tuner->direction = -tuner->direction;
+            tuner->steady = 0;
+            return tuner->threads;
+        }
+        tuner->settled = tuner->threads;
+        tuner->before = rate;
+    } else if (++tuner->steady < TUNE_PROBE) {
+        return tuner->threads;
+    } else {
+        /* Threads left waiting mean there's no work for more */
+        if (work_queue_waiting(paths) > 0)
+            tuner->direction = -1;
+        tuner->before = rate;
+        tuner->steady = 0;
+    }
+
+    step = (tuner->threads / 4 > 1) ? (tuner->threads / 4) : 1;
+    next = tuner->threads + (tuner->direction * step);
+    if (next < 1 || next > maxThreads) {
+        tuner->direction = -tuner->direction;
+        next = tuner->threads + (tuner->direction * step);
+    }
+    if (next >= 1 && next <= maxThreads)
+        tuner->threads = next;
+
+    return tuner->threads;
+}
+
+/*
+ * Starts the thread of the worker 'worker' as another one on the work queue. Returns 0
+ * if successful, 1 if not.
+ */
+static int start_thread(struct crawler_worker_t *worker) {
+
+    /* Joins before the thread runs, so the crawl cannot be taken to be over without it */
+    work_queue_join(worker->info->paths);
+    worker->retiring = 0;
+    atomic_store_explicit(&(worker->retired), 0, memory_order_relaxed);
+    running++;
+    if (create_thread(worker, run_worker) != 0) {
+        running--;
+        work_queue_leave(worker->info->paths);
+        return 1;
+    }
+    worker->started = 1;
+
+    return 0;
+}
+
+/*
+ * Sets up the worker 'worker' as the 'index'th, then starts its thread. Returns 0 if
+ * successful, 1 if not.
+ */
+static int start_worker(struct crawler_worker_t *worker, struct crawler_args_t *args, int index, int uring) {
+
+    if (worker_init(worker, args, index) != 0)
+        return 1;
+    if (uring && (worker->ring = uring_new((unsigned)args->args->ioDepth)) != NULL)
+        worker->statRing = uring_new(STAT_BATCH);
+
+    if (start_thread(worker) != 0) {
+        worker_release(worker);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Watches the '*nWorkers' running workers at a fixed interval until all of them are
+ * finished, and returns the number of threads settled on with '-X auto'.
+ *
+ * With '-X auto', the number of threads working at once is tuned with the number of
+ * directories crawled in each interval. Workers busy but making no progress for longer
+ * than '--stall-after' are stuck in a call (e.g. on a hung network mount); for each one,
+ * another thread is let through the work queue, up to '--stall-threads', starting new
+ * workers if there are no held back ones left. Once the stuck calls return, the extra
+ * workers retire as they next run out of work of their own, and their slots are reused
+ * on the next stall. With '-X auto', extra workers held back by then stay parked.
+ */
+static int monitor_workers(struct crawler_worker_t workers[], int *nWorkers, int maxWorkers,
+                           struct crawler_args_t *args) {
+
+    ProgArgs *progArgs = args->args;
+    struct tuner_t tuner = { progArgs->autoThreads, progArgs->autoThreads, 0L, 1, TUNE_PROBE - 1 };
+    struct timespec deadline;
+    long seen[maxWorkers], progress, crawled, last = 0L;
+    long stallTicks = (progArgs->stallAfter * 1000000L + MONITOR_INTERVAL - 1L) / MONITOR_INTERVAL;
+    int still[maxWorkers], first = *nWorkers, base = *nWorkers, allowed = 0, stalled, keep, live, target, i;
+    int uring = (workers[0].ring != NULL);
+
+    if (progArgs->autoThreads > 0)
+        base = allowed = progArgs->autoThreads;
+    for (i = 0; i < maxWorkers; i++) {
+        seen[i] = -1L;
+        still[i] = 0;
+    }
+
+    (void)clock_gettime(CLOCK_REALTIME, &deadline);
+    (void)pthread_mutex_lock(&runLock);
+    for (;;) {
+        deadline.tv_nsec += MONITOR_INTERVAL;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (running > 0 && pthread_cond_timedwait(&runCond, &runLock, &deadline) != ETIMEDOUT)
+            ;
+        if (running == 0)
+            break;
+
+        if (progArgs->autoThreads > 0) {
+            for (crawled = 0L, i = 0; i < *nWorkers; i++)
+                crawled += atomic_load_explicit(&(workers[i].nDirs), memory_order_relaxed);
+            base = tune_threads(&tuner, args->paths, progArgs->nThreads, crawled - last);
+            last = crawled;
+        }
+
+        /* Retired workers are joined, their slots are free for the next stall */
+        for (live = first, i = first; i < *nWorkers; i++) {
+            if (workers[i].started && atomic_load_explicit(&(workers[i].retired), memory_order_acquire)) {
+                (void)pthread_join(workers[i].thread, NULL);
+                workers[i].started = 0;
+            }
+            live += workers[i].started;
+        }
+
+        stalled = 0;
+        if (progArgs->stallAfter > 0L) {
+            for (i = 0; i < *nWorkers; i++) {
+                if (!workers[i].started)
+                    continue;
+                progress = atomic_load_explicit(&(workers[i].progress), memory_order_relaxed);
+                if (atomic_load_explicit(&(workers[i].idle), memory_order_relaxed) || progress != seen[i]) {
+                    seen[i] = progress;
+                    still[i] = 0;
+                } else if (++still[i] >= stallTicks) {
+                    stalled++;
+                }
+            }
+            if (stalled > progArgs->stallThreads)
+                stalled = progArgs->stallThreads;
+
+            /* Workers past those needed retire, the missing ones are started */
+            keep = (base + stalled > first) ? (base + stalled) : first;
+            atomic_store_explicit(&(args->keepWorkers), keep, memory_order_relaxed);
+            for (i = first; i < keep && i < maxWorkers; i++) {
+                if (i < *nWorkers) {
+                    if (!workers[i].started && start_thread(&(workers[i])) == 0) {
+                        seen[i] = -1L;
+                        still[i] = 0;
+                        live++;
+                    }
+                } else if (start_worker(&(workers[i]), args, i, uring) == 0) {
+                    (*nWorkers)++;
+                    atomic_store_explicit(&(args->nWorkers), *nWorkers, memory_order_release);
+                    live++;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        /*
+         * Only '-X auto' holds threads back; otherwise the extra workers need no throttle
+         * to be let through, nor to retire, so the work queue is left unthrottled
+         */
+        target = (progArgs->autoThreads > 0) ? (base + stalled) : 0;
+        if (target >= live)
+            target = 0;
+        if (target != allowed) {
+            allowed = target;
+            work_queue_throttle(args->paths, allowed);
+        }
+    }
+    (void)pthread_mutex_unlock(&runLock);
+
+    return (progArgs->autoThreads > 0) ? tuner.settled : progArgs->nThreads;
+}
+
+/*
+ * Returns the device of the directory 'item', the key of its lane in the work queue.
+ */
+static uint64_t directory_device(void *item) {
+    return ((CrDir *)item)->dev;
+}
+
+/*
+ * Gives the work queue the cost of the directory 'item' on a past crawl.
+ */
+static long directory_cost(void *item) {
+    return ((CrDir *)item)->cost;
+}
+
+/*
+ * Returns 1 if the device 'dev' is a spinning disk. Partitions have no queue of their
+ * own in sysfs, so the disk they're on is looked up instead.
+ */
+static int device_rotational(uint64_t dev) {
+
+    char path[128];
+    FILE *fp;
+    int c = '0';
+
+    snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/queue/rotational", major(dev), minor(dev));
+    if ((fp = fopen(path, "r")) == NULL) {
+        snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../queue/rotational", major(dev), minor(dev));
+        fp = fopen(path, "r");
+    }
+    if (fp != NULL) {
+        c = fgetc(fp);
+        fclose(fp);
+    }
+
+    return c == '1';
+}
+
+/*
+ * Returns the number of directories that may be crawled at once on the device 'dev':
+ * the limit set on it, the limit set on all devices, or, when detecting limits, a low
+ * limit for spinning disks (whose seeks only get slower with more requests at once)
+ * and none for the rest. Returns 0 if there is no limit.
+ */
+static int device_limit(uint64_t dev, void *arg) {
+
+    struct crawler_args_t *info = (struct crawler_args_t *)arg;
+    int i;
+
+    for (i = 0; i < info->nLimits; i++) {
+        if (info->limits[i].dev == dev)
+            return info->limits[i].limit;
+    }
+    if (info->args->deviceLimit == DEVICE_LIMIT_AUTO)
+        return device_rotational(dev) ? ROTATIONAL_LIMIT : 0;
+
+    return (info->args->deviceLimit > 0) ? info->args->deviceLimit : 0;
+}
+
+/*
+ * Sets the budget of descriptors that may be held open for pending children. The
+ * soft RLIMIT_NOFILE is raised to the hard limit first, if possible.
+ */
+static void set_fd_budget(int nThreads) {
+
+    struct rlimit limit;
+    long max = 1024L;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if (limit.rlim_cur < limit.rlim_max) {
+            rlim_t prev = limit.rlim_cur;
+            limit.rlim_cur = limit.rlim_max;
+            if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+                limit.rlim_cur = prev;
+        }
+        max = (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > (1UL << 20))
+            ? (1L << 20) : (long)limit.rlim_cur;
+    }
+
+    /* Each thread may also hold a descriptor of its own, plus one to reopen a parent */
+    fdBudget = max - FD_RESERVE - (2L * nThreads);
+    if (fdBudget < 0L)
+        fdBudget = 0L;
+}
+
+/*
+ * Sets up an io_uring for each worker. If io_uring is unavailable, all workers are
+ * left with no ring and fall back to the sync engine.
+ */
+static void setup_rings(struct crawler_worker_t workers[], int nWorkers, ProgArgs *progArgs) {
+
+    int i, j;
+
+    for (i = 0; i < nWorkers; i++) {
+        if ((workers[i].ring = uring_new((unsigned)progArgs->ioDepth)) == NULL) {
+            if (!GET_BIT(progArgs->progFlags, NO_WARN))
+                fprintf(stderr, "WARNING: io_uring is unavailable (%s), falling back to the sync engine.\n",
+                        strerror(errno));
+            for (j = 0; j < i; j++) {
+                uring_destroy(workers[j].ring);
+                uring_destroy(workers[j].statRing);
+                workers[j].ring = NULL;
+                workers[j].statRing = NULL;
+            }
+            return;
+        }
+        /* Entry types are resolved on a ring of their own, so their completions never mix with opens */
+        workers[i].statRing = uring_new(STAT_BATCH);
+    }
+}
+
+void process(RegexEngine *regex, RegexEngine *prune, ConcurrentTreeSet *results, WorkQueue *paths, ProgArgs *progArgs) {
+
+    struct crawler_args_t args = { regex, prune, results, paths, progArgs, NULL, OPEN_FLAGS|O_NOFOLLOW, STAT_FLAGS,
+                                   STAT_MASK, 0, 0, 0, NULL, 0, NULL, NULL, 0, NULL, 0, 0 };
+    int i, nWorkers = progArgs->nThreads, threads = progArgs->nThreads;
+    int maxWorkers = nWorkers + ((progArgs->stallAfter > 0L) ? progArgs->stallThreads : 0);
+    struct crawler_worker_t workers[maxWorkers];
+    long nDirs = 0L, spillAfter = progArgs->spillAfter;
+
+    set_fd_budget(maxWorkers);
+
+    /* Links are followed when opening and resolving entries, and loops are detected */
+    if (GET_BIT(progArgs->progFlags, FOLLOW_LINKS)) {
+        if (inode_set_new(&(args.visited)) != OK) {
+            fprintf(stderr, "ERROR: Failed to allocate enough memory from heap.\n");
+            return;
+        }
+        args.openFlags = OPEN_FLAGS;
+        args.statFlags = STAT_FOLLOW_FLAGS;
+    }
+
+    /*
+     * Past the limit, queued directories are spilled to a file rather than held in memory.
+     * The hybrid traversal keeps its frontier bounded by spilling past its own limit.
+     */
+    if (spillAfter == 0L && progArgs->traversal == TRAVERSAL_HYBRID)
+        spillAfter = progArgs->frontierLimit;
+    if (spillAfter > 0L) {
+        const char *dir = (progArgs->spillDir[0] != '\0') ? progArgs->spillDir : getenv("TMPDIR");
+        int err;
+        if (dir == NULL || dir[0] == '\0')
+            dir = "/tmp";
+        if ((err = work_queue_spill(paths, spillAfter, dir, spill_directory, unspill_directory,
+                                    (void *)crawler_dir_free)) != 0 && !GET_BIT(progArgs->progFlags, NO_WARN))
+            fprintf(stderr, "WARNING: Failed to create a spill file in %s (%s), directories will be kept in memory.\n",
+                    dir, strerror(err));
+    }
+
+    /* Each device gets a lane of its own in the work queue, with its own limit */
+    struct device_limit_t limits[MAX_LIMITS];
+    if (progArgs->deviceLimit != 0 || progArgs->nLimits > 0) {
+        struct stat sb;
+        for (i = 0; i < progArgs->nLimits; i++) {
+            if (stat(progArgs->limitPaths[i], &sb) != 0) {
+                if (!GET_BIT(progArgs->progFlags, NO_WARN))
+                    fprintf(stderr, "WARNING: Failed to look up %s (%s), its device limit is ignored.\n",
+                            progArgs->limitPaths[i], strerror(errno));
+                continue;
+            }
+            limits[args.nLimits].dev = sb.st_dev;
+            limits[args.nLimits].limit = progArgs->limits[i];
+            args.nLimits++;
+        }
+        args.limits = limits;
+        args.lanes = 1;
+        (void)work_queue_lanes(paths, directory_device, device_limit, &args);
+    }
+
+    /*
+     * The directories that took longest on past crawls are queued ahead of the others.
+     * There is no file to load from on the first crawl, only one to save to.
+     */
+    if (progArgs->historyFile[0] != '\0') {
+        if (cost_history_new(&history) != OK) {
+            if (!GET_BIT(progArgs->progFlags, NO_WARN))
+                fprintf(stderr, "WARNING: Failed to allocate the cost history, costs will not be recorded.\n");
+        } else if (cost_history_load(history, progArgs->historyFile) == ALLOC_FAILURE ||
+                   work_queue_priority(paths, directory_cost) != 0) {
+            if (!GET_BIT(progArgs->progFlags, NO_WARN))
+                fprintf(stderr, "WARNING: Failed to load the cost history from %s, directories are queued as usual.\n",
+                        progArgs->historyFile);
+        }
+        /* The costs saved for the trees crawled are replaced, the others are kept */
+        for (i = 0; history != NULL && (i < progArgs->nPaths || (i == 0 && progArgs->nPaths == 0)); i++)
+            (void)cost_history_crawled(history, (progArgs->nPaths == 0) ? "./" : progArgs->searchPaths[i]);
+    }
+
+    /* The hybrid traversal switches on the size of the frontier */
+    if (progArgs->traversal == TRAVERSAL_HYBRID || GET_BIT(progArgs->progFlags, SHOW_STATS))
+        trackFrontier = 1;
+
+    /* Sub-directories are queued in inode order, which may need resolved entries' inodes */
+    if (GET_BIT(progArgs->progFlags, INODE_ORDER)) {
+        args.inodeOrder = 1;
+        args.statMask |= STATX_INO;
+    }
+
+    /* Sub-directories are checked for mount crossings before they are ever queued */
+    if (GET_BIT(progArgs->progFlags, ONE_FILE_SYSTEM) || GET_BIT(progArgs->progFlags, DEDUP_MOUNTS) ||
+        progArgs->skipFsTypes[0] != '\0') {
+        args.mountAware = 1;
+        args.statMask |= STATX_MNT_ID;
+        if (GET_BIT(progArgs->progFlags, DEDUP_MOUNTS) || progArgs->skipFsTypes[0] != '\0') {
+            if (mount_table_new(&(args.mounts)) != OK && !GET_BIT(progArgs->progFlags, NO_WARN))
+                fprintf(stderr, "WARNING: Failed to load the mount table, mounts will not be skipped by type.\n");
+        }
+        /* Which mount each duplicated subtree is entered through is settled before crawling */
+        if (GET_BIT(progArgs->progFlags, DEDUP_MOUNTS) && args.mounts != NULL) {
+            for (i = 0; i < progArgs->nPaths || (i == 0 && progArgs->nPaths == 0); i++)
+                (void)mount_table_add_path(args.mounts, (progArgs->nPaths == 0) ? "./" : progArgs->searchPaths[i]);
+            if (mount_table_resolve(args.mounts) != OK) {
+                fprintf(stderr, "ERROR: Failed to allocate enough memory from heap.\n");
+                cost_history_destroy(history);
+                history = NULL;
+                inode_set_destroy(args.visited);
+                mount_table_destroy(args.mounts);
+                return;
+            }
+        }
+    }
+
+    /*
+     * Workers are pinned to the CPUs in turn, node by node. Each node gets a shard of the
+     * work queue, so the directories found on a node are crawled there, while their
+     * memory is still close, unless threads elsewhere run out of work.
+     */
+    if (GET_BIT(progArgs->progFlags, PIN_THREADS)) {
+        int nNodes;
+        if (cpu_topology_load(&(args.cpus), &(args.nCpus), &nNodes) != OK || args.nCpus == 0) {
+            if (!GET_BIT(progArgs->progFlags, NO_WARN))
+                fprintf(stderr, "WARNING: Failed to list the CPUs, threads will not be pinned.\n");
+            free(args.cpus);
+            args.cpus = NULL;
+        } else if (nNodes > 1 && work_queue_shards(paths, nNodes) != 0 && !GET_BIT(progArgs->progFlags, NO_WARN)) {
+            fprintf(stderr, "WARNING: Failed to split the work queue by node, all threads will share it.\n");
+        }
+    }
+
+    /*
+     * Allocates each thread's directory reader up front. The work queue expects
+     * every one of the threads to run, so none can be left out.
+     */
+    for (i = 0; i < nWorkers; i++) {
+        if (worker_init(&(workers[i]), &args, i) != 0) {
+            fprintf(stderr, "ERROR: Failed to allocate enough memory from heap.\n");
+            while (--i >= 0)
+                worker_release(&(workers[i]));
+            cost_history_destroy(history);
+            history = NULL;
+            inode_set_destroy(args.visited);
+            mount_table_destroy(args.mounts);
+            return;
+        }
+    }
+    if (progArgs->engine == ENGINE_URING)
+        setup_rings(workers, nWorkers, progArgs);
+
+    /* With '-X auto', threads past the tuned count are held back by the work queue */
+    if (progArgs->autoThreads > 0)
+        work_queue_throttle(paths, progArgs->autoThreads);
+
+    /* Creates the threads for kickoff, then wait for all to complete */
+    args.workers = workers;
+    atomic_store(&(args.nWorkers), nWorkers);
+    atomic_store(&(args.keepWorkers), nWorkers);
+    running = nWorkers;
+    for (i = 0; i < nWorkers; i++)
+        workers[i].started = (create_thread(&(workers[i]), run_worker) == 0);
+    if (progArgs->autoThreads > 0 || progArgs->stallAfter > 0L)
+        threads = monitor_workers(workers, &nWorkers, maxWorkers, &args);
+    /* Threads may steal from any worker until they all finish */
+    for (i = 0; i < nWorkers; i++) {
+        if (workers[i].started)
+            (void)pthread_join(workers[i].thread, NULL);
+    }
+    for (i = 0; i < nWorkers; i++) {
+        nDirs += workers[i].nDirs;
+        worker_release(&(workers[i]));
+    }
+    inode_set_destroy(args.visited);
+    mount_table_destroy(args.mounts);
+    free(args.cpus);
+
+    /* Every directory has been freed, and its cost recorded, once the threads are done */
+    if (history != NULL) {
+        int err;
+        if ((err = cost_history_save(history, progArgs->historyFile)) != 0 && !GET_BIT(progArgs->progFlags, NO_WARN))
+            fprintf(stderr, "WARNING: Failed to save the cost history to %s (%s).\n", progArgs->historyFile,
+                    strerror(err));
+        cost_history_destroy(history);
+        history = NULL;
+    }
+
+    /* Reports the count settled on, so it can be passed to '-X' on later runs */
+    if (progArgs->autoThreads > 0 && !GET_BIT(progArgs->progFlags, SHOW_STATS) &&
+        !GET_BIT(progArgs->progFlags, NO_WARN))
+        fprintf(stderr, "Threads: settled on %d of %d\n", threads, progArgs->nThreads);
+
+    /* Prints the statistics apart from the results, so they can be redirected */
+    if (GET_BIT(progArgs->progFlags, SHOW_STATS)) {
+        static const char *traversals[] = { "bfs", "dfs", "hybrid" };
+        char size[32];
+        fprintf(stderr, "Traversal: %s\n", traversals[progArgs->traversal]);
+        fprintf(stderr, "Threads: %d\n", threads);
+        if (nWorkers > progArgs->nThreads)
+            fprintf(stderr, "Threads started for stalled threads: %d\n", nWorkers - progArgs->nThreads);
+        fprintf(stderr, "Directories crawled: %ld\n", nDirs);
+        fprintf(stderr, "Peak frontier: %ld directories, %s\n", atomic_load(&peakDirs),
+                file_size_format(atomic_load(&peakBytes), size, sizeof(size)));
+        if (spillAfter > 0L)
+            fprintf(stderr, "Directories spilled: %ld\n", work_queue_spilled(paths));
     }
 }
 
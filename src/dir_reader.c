@@ -0,0 +1,126 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "dir_reader.h"
+
+/*
+ * The struct for the directory reader ADT.
+ */
+struct dir_reader {
+    char *buffer;       /* The buffer the kernel fills with records */
+    size_t size;        /* The size of the buffer */
+    long len;           /* Number of valid bytes currently in the buffer */
+    long pos;           /* Offset of the next record in the buffer */
+    int fd;             /* The directory being read */
+    int error;          /* The errno of the last failed read */
+    int eof;            /* Set once the kernel reports no more entries */
+};
+
+DirReader *dir_reader_new(size_t size) {
+
+    DirReader *reader;
+
+    if ((reader = (DirReader *)malloc(sizeof(DirReader))) != NULL) {
+        reader->size = (size == 0) ? DIR_READER_DEFAULT_SIZE : size;
+        if ((reader->buffer = (char *)malloc(reader->size)) != NULL) {
+            reader->len = 0L;
+            reader->pos = 0L;
+            reader->fd = -1;
+            reader->error = 0;
+            reader->eof = 1;
+        } else {
+            free(reader);
+            reader = NULL;
+        }
+    }
+
+    return reader;
+}
+
+void dir_reader_open(DirReader *reader, int fd) {
+    reader->fd = fd;
+    reader->len = 0L;
+    reader->pos = 0L;
+    reader->error = 0;
+    reader->eof = 0;
+}
+
+/*
+ * Refills the buffer with the next batch of records. Returns 0 if records were
+ * read, or 1 if the end of the directory was reached or the read failed.
+ */
+static int refill(DirReader *reader) {
+
+    long bytes;
+
+    if (reader->eof)
+        return 1;
+
+    /* glibc only wraps getdents64() from 2.30 onwards, so call it directly */
+    do {
+        bytes = syscall(SYS_getdents64, reader->fd, reader->buffer, reader->size);
+    } while (bytes < 0 && errno == EINTR);
+
+    if (bytes <= 0) {
+        reader->error = (bytes < 0) ? errno : 0;
+        reader->eof = 1;
+        reader->len = 0L;
+        reader->pos = 0L;
+        return 1;
+    }
+
+    reader->len = bytes;
+    reader->pos = 0L;
+    return 0;
+}
+
+DirEntry *dir_reader_next(DirReader *reader) {
+
+    DirEntry *entry;
+
+    if (reader->pos >= reader->len && refill(reader) != 0)
+        return NULL;
+
+    /* Records are walked in place, d_reclen points at the next one */
+    entry = (DirEntry *)(reader->buffer + reader->pos);
+    reader->pos += entry->d_reclen;
+
+    return entry;
+}
+
+int dir_reader_error(DirReader *reader) {
+    return reader->error;
+}
+
+void dir_reader_destroy(DirReader *reader) {
+
+    if (reader != NULL) {
+        free(reader->buffer);
+        free(reader);
+    }
+}
@@ -35,6 +35,7 @@
 
 static ProgArgs *args = NULL;
 static RegexEngine *regex = NULL;
+static RegexEngine *prune = NULL;
 static ConcurrentTreeSet *results = NULL;
 static WorkQueue *paths = NULL;
 
@@ -64,8 +65,11 @@ static void cleanUp(void) {
         ts_treeset_destroy(results, free);
     if (paths != NULL)
         work_queue_destroy(paths, (void *)crawler_dir_free);
+    crawler_dir_teardown();
     if (regex != NULL)
         destroy_regex_engine(regex);
+    if (prune != NULL)
+        destroy_regex_engine(prune);
 }
 
 /*
@@ -101,19 +105,39 @@ int main(int argc, char **argv) {
         error(2, "ERROR: Failed to allocate enough memory from heap.");
     if (work_queue_new(&paths, args->nThreads) != OK)
         error(2, "ERROR: Failed to allocate enough memory from heap.");
+    if (crawler_dir_setup() != OK)
+        error(2, "ERROR: Failed to allocate enough memory from heap.");
     if ((regex = regex_engine_new(1)) == NULL)
         error(2, "ERROR: Failed to allocate enough memory from heap.");
     cflags = (!GET_BIT(args->progFlags, IGNORE_CASE)) ? REG_EXTENDED|REG_NEWLINE : REG_EXTENDED|REG_NEWLINE|REG_ICASE;
-    status = regex_engine_compile_pattern(regex, args->regex, cflags);
+    /* Plain bash patterns are matched without a regex, only the rest are compiled */
+    status = regex_engine_add_glob(regex, args->pattern, cflags);
+    if (status)
+        status = regex_engine_compile_pattern(regex, args->regex, cflags);
     if (status) {
         (void)regex_engine_error(regex, buffer, sizeof(buffer));
         error(2, "ERROR: Failed to compile the pattern '%s' - %s", args->regex, buffer);
     }
 
+    /* The prune patterns are matched together, as a single regex if any of them needs one */
+    if (args->prune[0] != '\0') {
+        const char *glob;
+        if ((prune = regex_engine_new(1)) == NULL)
+            error(2, "ERROR: Failed to allocate enough memory from heap.");
+        for (glob = args->pruneGlobs; *glob != '\0'; glob += strlen(glob) + 1) {
+            if (regex_engine_add_glob(prune, glob, 0) != 0)
+                break;
+        }
+        if (*glob != '\0' && regex_engine_compile_pattern(prune, args->prune, REG_EXTENDED|REG_NEWLINE|REG_NOSUB)) {
+            (void)regex_engine_error(prune, buffer, sizeof(buffer));
+            error(2, "ERROR: Failed to compile the prune patterns '%s' - %s", args->prune, buffer);
+        }
+    }
+
     /* Adds each of the specified search directories into the list */
     if (args->nPaths == 0) {
         /* If user has not specified any paths, add current working directory */
-        if ((dir = crawler_dir_malloc("./", args->maxDepth, args->minDepth)) == NULL) {
+        if ((dir = crawler_dir_malloc(NULL, "./", args->maxDepth, args->minDepth)) == NULL) {
             error(2, "ERROR: Failed to allocate enough memory from heap.");
         }
         if (work_queue_add(paths, dir) != 0) {
@@ -124,7 +148,7 @@ int main(int argc, char **argv) {
         /* Otherwise, add each of the specified paths into the list */
         int i;
         for (i = 0; i < args->nPaths; i++) {
-            if ((dir = crawler_dir_malloc(args->searchPaths[i], args->maxDepth, args->minDepth)) == NULL) {
+            if ((dir = crawler_dir_malloc(NULL, args->searchPaths[i], args->maxDepth, args->minDepth)) == NULL) {
                 error(2, "ERROR: Failed to allocate enough memory from heap.");
             }
             if (work_queue_add(paths, dir) != 0) {
@@ -138,7 +162,7 @@ int main(int argc, char **argv) {
      * Crawls over the files, prints the results, then cleans up all the
      * heap storage
      */
-    process(regex, results, paths, args);
+    process(regex, prune, results, paths, args);
     display_results(results, args->maxResults, args->progFlags);
     cleanUp();
 
@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "file_utils.h"
 
@@ -34,7 +36,7 @@
 #define KILOBYTE 1000
 #define MEGABYTE (1000 * KILOBYTE)
 #define GIGABYTE (1000 * MEGABYTE)
-#define TERABYTE (1000 * GIGABYTE)
+#define TERABYTE (1000LL * GIGABYTE)
 
 char *file_path_append(char path[], char sep) {
 
@@ -56,3 +58,54 @@ char *file_path_deduct(char path[], char sep) {
 
     return path;
 }
+
+long long file_size_parse(const char *str) {
+
+    char *after;
+    long long size = strtoll(str, &after, 10);
+
+    if (after == str || size < 0)
+        return -1;
+
+    /* Applies the unit suffix, if any */
+    switch (*after) {
+        case '\0':
+        case BYTE:
+            break;
+        case KILO:
+            size *= KILOBYTE;
+            break;
+        case MEGA:
+            size *= MEGABYTE;
+            break;
+        case GIGA:
+            size *= GIGABYTE;
+            break;
+        case TERA:
+            size *= TERABYTE;
+            break;
+        default:
+            return -1;
+    }
+    /* Only a single suffix character is allowed */
+    if (*after != '\0' && *(after + 1) != '\0')
+        return -1;
+
+    return size;
+}
+
+char *file_size_format(long long size, char buffer[], size_t len) {
+
+    if (size >= TERABYTE)
+        snprintf(buffer, len, "%.1f%c", (double)size / TERABYTE, TERA);
+    else if (size >= GIGABYTE)
+        snprintf(buffer, len, "%.1f%c", (double)size / GIGABYTE, GIGA);
+    else if (size >= MEGABYTE)
+        snprintf(buffer, len, "%.1f%c", (double)size / MEGABYTE, MEGA);
+    else if (size >= KILOBYTE)
+        snprintf(buffer, len, "%.1f%c", (double)size / KILOBYTE, KILO);
+    else
+        snprintf(buffer, len, "%lld%c", size, BYTE);
+
+    return buffer;
+}
@@ -0,0 +1,380 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "glob_matcher.h"
+
+/*
+ * The shapes of pattern matched with plain string comparisons.
+ */
+typedef enum {
+    SHAPE_EXACT,        /* 'lit' */
+    SHAPE_PREFIX,       /* 'lit*' */
+    SHAPE_SUFFIX,       /* '*lit' */
+    SHAPE_CONTAINS,     /* '*lit*', or '*' with an empty literal */
+    SHAPE_PROGRAM       /* Anything else, matched by running its program */
+} Shape;
+
+/*
+ * The operations of a pattern's program.
+ */
+typedef enum {
+    OP_CHAR,            /* Matches the one character */
+    OP_ANY,             /* '?', matches any character */
+    OP_CLASS,           /* '[...]', matches any character of a class */
+    OP_STAR             /* '*', matches any run of characters */
+} OpCode;
+
+typedef struct {
+    OpCode code;
+    unsigned char c;            /* The character of OP_CHAR, folded when ignoring case */
+    int cls;                    /* Index of the class of OP_CLASS */
+} Op;
+
+/*
+ * A set of characters, a bit per character.
+ */
+typedef struct {
+    uint8_t bits[32];
+} CharClass;
+
+/*
+ * A compiled pattern.
+ */
+typedef struct {
+    Shape shape;
+    unsigned char *lit;         /* The literal of the shape, folded when ignoring case */
+    size_t litLen;              /* The length of the literal */
+    Op *ops;                    /* The program */
+    int nOps;                   /* Number of operations in the program */
+    CharClass *classes;         /* The classes of the program's OP_CLASS operations */
+} Glob;
+
+/*
+ * Struct for the glob matcher.
+ */
+struct glob_matcher {
+    int ignoreCase;             /* Set if letters match regardless of their case */
+    unsigned char fold[256];    /* Each character, lowered when ignoring case */
+    Glob *globs;                /* The patterns added */
+    int nGlobs;                 /* Number of patterns added */
+};
+
+#define CLASS_SET(cls, ch) ((cls)->bits[(ch) >> 3] |= (uint8_t)(1U << ((ch) & 7)))
+#define CLASS_HAS(cls, ch) ((cls)->bits[(ch) >> 3] & (1U << ((ch) & 7)))
+
+/*
+ * Parses the bracket expression that starts right after the '[' at 'p' into 'cls', and
+ * stores where the pattern continues into '*end'. Ranges span characters by their
+ * value, as they do in the C locale, and are only taken between two digits or two
+ * letters of the same case. Returns 0 if successful, 1 if the expression is
+ * not terminated or uses syntax left to the regex engine.
+ */
+static int parse_class(const GlobMatcher *matcher, const char *p, CharClass *cls, const char **end) {
+
+    int negate = 0, first = 1, c, lo, hi;
+    CharClass set;
+
+    memset(&set, 0, sizeof(set));
+    if (*p == '^') {
+        negate = 1;
+        p++;
+    }
+
+    /* A ']' right after the opening bracket is a member, not the end */
+    while (*p != ']' || first) {
+        /* Character classes ('[:alpha:]' and such), and what the conversion to a regex escapes */
+        if (*p == '\0' || *p == '[' || *p == '\\' || *p == '.' || *p == '?' || *p == '*' || *p == '\n')
+            return 1;
+        lo = hi = (unsigned char)*p++;
+        if (*p == '-' && p[1] != ']' && p[1] != '\0') {
+            hi = (unsigned char)p[1];
+            p += 2;
+            /* Only ranges of digits or letters of one case mean the same in every locale */
+            if (hi < lo || !((isdigit(lo) && isdigit(hi)) || (islower(lo) && islower(hi)) || (isupper(lo) && isupper(hi))))
+                return 1;
+        } else if (lo == '-' && !first && *p != ']') {
+            /* A '-' anywhere but at either end is left to the regex engine to judge */
+            return 1;
+        }
+        for (c = lo; c <= hi; c++)
+            CLASS_SET(&set, c);
+        first = 0;
+    }
+    *end = p + 1;
+
+    /* Both cases of each letter are members, before the set is negated */
+    if (matcher->ignoreCase) {
+        for (c = 0; c < 256; c++) {
+            if (CLASS_HAS(&set, c)) {
+                CLASS_SET(&set, tolower(c));
+                CLASS_SET(&set, toupper(c));
+            }
+        }
+    }
+    for (c = 0; c < 32; c++)
+        cls->bits[c] = negate ? (uint8_t)~set.bits[c] : set.bits[c];
+
+    return 0;
+}
+
+/*
+ * Compiles 'pattern' into 'glob'. Returns 0 if successful, 1 if the pattern uses syntax
+ * left to the regex engine, or allocation failed.
+ */
+static int compile_glob(const GlobMatcher *matcher, const char *pattern, Glob *glob) {
+
+    size_t len = strlen(pattern);
+    const char *p = pattern;
+    int i, start, end, nClasses = 0;
+    Op *op;
+
+    memset(glob, 0, sizeof(Glob));
+    if ((glob->ops = (Op *)malloc((len + 1) * sizeof(Op))) == NULL ||
+        (glob->classes = (CharClass *)malloc((len / 2 + 1) * sizeof(CharClass))) == NULL ||
+        (glob->lit = (unsigned char *)malloc(len + 1)) == NULL)
+        return 1;
+
+    while (*p != '\0') {
+        op = &(glob->ops[glob->nOps]);
+        switch (*p) {
+            case '*':
+                /* A run of stars is one star */
+                if (glob->nOps == 0 || glob->ops[glob->nOps - 1].code != OP_STAR) {
+                    op->code = OP_STAR;
+                    glob->nOps++;
+                }
+                p++;
+                break;
+            case '?':
+                op->code = OP_ANY;
+                glob->nOps++;
+                p++;
+                break;
+            case '[':
+                if (parse_class(matcher, p + 1, &(glob->classes[nClasses]), &p) != 0)
+                    return 1;
+                op->code = OP_CLASS;
+                op->cls = nClasses++;
+                glob->nOps++;
+                break;
+            /* Syntax of the regex the pattern is otherwise converted to */
+            case '+': case '(': case ')': case '|': case '{': case '}':
+            case '^': case '$': case '\\': case '\n':
+                return 1;
+            default:
+                op->code = OP_CHAR;
+                op->c = matcher->fold[(unsigned char)*p];
+                glob->nOps++;
+                p++;
+                break;
+        }
+    }
+
+    /* Patterns that are only literal characters between optional stars need no program */
+    start = (glob->nOps > 0 && glob->ops[0].code == OP_STAR) ? 1 : 0;
+    end = (glob->nOps > start && glob->ops[glob->nOps - 1].code == OP_STAR) ? glob->nOps - 1 : glob->nOps;
+    for (i = start; i < end && glob->ops[i].code == OP_CHAR; i++)
+        glob->lit[glob->litLen++] = glob->ops[i].c;
+    if (i < end)
+        glob->shape = SHAPE_PROGRAM;
+    else if (start == 0)
+        glob->shape = (end == glob->nOps) ? SHAPE_EXACT : SHAPE_PREFIX;
+    else
+        glob->shape = (end == glob->nOps && glob->nOps > 1) ? SHAPE_SUFFIX : SHAPE_CONTAINS;
+
+    return 0;
+}
+
+/*
+ * Returns 1 if the 'len' characters at 's' equal the literal 'lit', 0 if not.
+ */
+static int literal_equals(const GlobMatcher *matcher, const unsigned char *s, const unsigned char *lit, size_t len) {
+
+    size_t i;
+
+    if (!matcher->ignoreCase)
+        return memcmp(s, lit, len) == 0;
+    for (i = 0; i < len; i++) {
+        if (matcher->fold[s[i]] != lit[i])
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Returns 1 if the literal 'lit' is found in the 'len' characters at 's', 0 if not.
+ */
+static int literal_within(const GlobMatcher *matcher, const unsigned char *s, size_t len,
+                          const unsigned char *lit, size_t litLen) {
+
+    size_t i;
+
+    if (!matcher->ignoreCase)
+        return memmem(s, len, lit, litLen) != NULL;
+    for (i = 0; i + litLen <= len; i++) {
+        if (literal_equals(matcher, s + i, lit, litLen))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Runs the program of 'glob' over the 'len' characters at 's'. On a mismatch, the last
+ * star seen takes one more character and the rest of the program is tried again from
+ * there, so a pattern is matched in at most (pattern * name) steps.
+ */
+static int run_program(const GlobMatcher *matcher, const Glob *glob, const unsigned char *s, size_t len) {
+
+    int p = 0, starP = -1;
+    size_t i = 0, starI = 0;
+    const Op *op;
+
+    while (i < len) {
+        if (p < glob->nOps) {
+            op = &(glob->ops[p]);
+            if (op->code == OP_STAR) {
+                starP = ++p;
+                starI = i;
+                continue;
+            }
+            if (op->code == OP_ANY ||
+                (op->code == OP_CHAR && matcher->fold[s[i]] == op->c) ||
+                (op->code == OP_CLASS && CLASS_HAS(&(glob->classes[op->cls]), s[i]))) {
+                p++;
+                i++;
+                continue;
+            }
+        }
+        if (starP < 0)
+            return 0;
+        p = starP;
+        i = ++starI;
+    }
+
+    while (p < glob->nOps && glob->ops[p].code == OP_STAR)
+        p++;
+    return p == glob->nOps;
+}
+
+/*
+ * Returns 1 if the line of 'len' characters at 's' matches 'glob', 0 if not.
+ */
+static int match_line(const GlobMatcher *matcher, const Glob *glob, const unsigned char *s, size_t len) {
+
+    switch (glob->shape) {
+        case SHAPE_EXACT:
+            return len == glob->litLen && literal_equals(matcher, s, glob->lit, len);
+        case SHAPE_PREFIX:
+            return len >= glob->litLen && literal_equals(matcher, s, glob->lit, glob->litLen);
+        case SHAPE_SUFFIX:
+            return len >= glob->litLen && literal_equals(matcher, s + len - glob->litLen, glob->lit, glob->litLen);
+        case SHAPE_CONTAINS:
+            return literal_within(matcher, s, len, glob->lit, glob->litLen);
+        default:
+            return run_program(matcher, glob, s, len);
+    }
+}
+
+/*
+ * Frees the memory held by 'glob'.
+ */
+static void free_glob(Glob *glob) {
+    free(glob->ops);
+    free(glob->classes);
+    free(glob->lit);
+}
+
+Status glob_matcher_new(GlobMatcher **matcher, int ignoreCase) {
+
+    GlobMatcher *temp;
+    int c;
+
+    if ((temp = (GlobMatcher *)malloc(sizeof(GlobMatcher))) == NULL)
+        return ALLOC_FAILURE;
+
+    temp->ignoreCase = ignoreCase;
+    for (c = 0; c < 256; c++)
+        temp->fold[c] = (unsigned char)(ignoreCase ? tolower(c) : c);
+    temp->globs = NULL;
+    temp->nGlobs = 0;
+    *matcher = temp;
+
+    return OK;
+}
+
+int glob_matcher_add(GlobMatcher *matcher, const char *pattern) {
+
+    Glob glob, *temp;
+
+    if (compile_glob(matcher, pattern, &glob) != 0) {
+        free_glob(&glob);
+        return 1;
+    }
+    if ((temp = (Glob *)realloc(matcher->globs, (matcher->nGlobs + 1) * sizeof(Glob))) == NULL) {
+        free_glob(&glob);
+        return 1;
+    }
+
+    temp[matcher->nGlobs++] = glob;
+    matcher->globs = temp;
+    return 0;
+}
+
+int glob_matcher_isMatch(const GlobMatcher *matcher, const char *name) {
+
+    const unsigned char *s = (const unsigned char *)name, *nl;
+    size_t len = strlen(name), lineLen;
+    int i;
+
+    /* As with REG_NEWLINE, each line of the name is matched on its own */
+    for (;;) {
+        nl = (const unsigned char *)memchr(s, '\n', len);
+        lineLen = (nl != NULL) ? (size_t)(nl - s) : len;
+        for (i = 0; i < matcher->nGlobs; i++) {
+            if (match_line(matcher, &(matcher->globs[i]), s, lineLen))
+                return 1;
+        }
+        if (nl == NULL)
+            return 0;
+        len -= lineLen + 1;
+        s = nl + 1;
+    }
+}
+
+void glob_matcher_destroy(GlobMatcher *matcher) {
+
+    int i;
+
+    if (matcher != NULL) {
+        for (i = 0; i < matcher->nGlobs; i++)
+            free_glob(&(matcher->globs[i]));
+        free(matcher->globs);
+        free(matcher);
+    }
+}
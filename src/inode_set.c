@@ -0,0 +1,201 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "inode_set.h"
+
+/* Number of shards, must be a power of 2 */
+#define SHARDS 64
+/* Initial number of slots in each shard's table, must be a power of 2 */
+#define INITIAL_SLOTS 64
+
+/*
+ * Struct for a slot in a shard's table. Slots are empty while 'used' is 0.
+ */
+typedef struct {
+    uint64_t dev;       /* The file's device number */
+    uint64_t ino;       /* The file's inode number */
+    int used;           /* Set once the slot holds a file */
+} Slot;
+
+/*
+ * Struct for a shard: an open-addressed hash table with linear probing.
+ */
+typedef struct {
+    pthread_mutex_t lock;   /* The lock guarding the shard */
+    Slot *slots;            /* The table of slots */
+    long capacity;          /* Number of slots in the table */
+    long size;              /* Number of used slots */
+    char pad[64];           /* Keeps neighbouring shards off the same cache line */
+} Shard;
+
+/*
+ * Struct for the thread-safe inode set.
+ */
+struct inode_set {
+    Shard shards[SHARDS];   /* The shards */
+};
+
+/* Macro used for locking a shard */
+#define LOCK(x)    pthread_mutex_lock( &((x)->lock) )
+/* Macro used for unlocking a shard */
+#define UNLOCK(x)  pthread_mutex_unlock( &((x)->lock) )
+
+/*
+ * Mixes the device and inode numbers into a 64-bit hash. The low bits pick the slot,
+ * the high bits pick the shard.
+ */
+static uint64_t hash(uint64_t dev, uint64_t ino) {
+
+    uint64_t h = ino ^ (dev * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+Status inode_set_new(InodeSet **set) {
+
+    InodeSet *temp;
+    int i;
+
+    /* Allocates memory for the set */
+    if ((temp = (InodeSet *)malloc(sizeof(InodeSet))) == NULL)
+        return ALLOC_FAILURE;
+
+    /* Initializes each of the shards */
+    for (i = 0; i < SHARDS; i++) {
+        Shard *shard = &(temp->shards[i]);
+        if ((shard->slots = (Slot *)calloc(INITIAL_SLOTS, sizeof(Slot))) == NULL) {
+            while (--i >= 0) {
+                free(temp->shards[i].slots);
+                pthread_mutex_destroy(&(temp->shards[i].lock));
+            }
+            free(temp);
+            return ALLOC_FAILURE;
+        }
+        shard->capacity = INITIAL_SLOTS;
+        shard->size = 0L;
+        pthread_mutex_init(&(shard->lock), NULL);
+    }
+    *set = temp;
+
+    return OK;
+}
+
+/*
+ * Finds the slot holding the file, or the empty slot where it belongs.
+ */
+static Slot *findSlot(Slot *slots, long capacity, uint64_t h, uint64_t dev, uint64_t ino) {
+
+    long i = (long)(h & (uint64_t)(capacity - 1));
+
+    while (slots[i].used && (slots[i].dev != dev || slots[i].ino != ino))
+        i = (i + 1) & (capacity - 1);
+
+    return &(slots[i]);
+}
+
+/*
+ * Doubles the capacity of the shard's table, rehashing every file into it.
+ */
+static Status resize(Shard *shard) {
+
+    long i, capacity = shard->capacity * 2;
+    Slot *slots = (Slot *)calloc(capacity, sizeof(Slot));
+
+    if (slots == NULL)
+        return ALLOC_FAILURE;
+    for (i = 0L; i < shard->capacity; i++) {
+        Slot *old = &(shard->slots[i]);
+        if (old->used)
+            *findSlot(slots, capacity, hash(old->dev, old->ino), old->dev, old->ino) = *old;
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->capacity = capacity;
+
+    return OK;
+}
+
+Status inode_set_add(InodeSet *set, uint64_t dev, uint64_t ino) {
+
+    uint64_t h = hash(dev, ino);
+    Shard *shard = &(set->shards[h >> 58]);
+    Status status = OK;
+    Slot *slot;
+
+    LOCK(shard);
+    slot = findSlot(shard->slots, shard->capacity, h, dev, ino);
+    if (slot->used) {
+        status = ALREADY_EXISTS;
+    } else {
+        slot->dev = dev;
+        slot->ino = ino;
+        slot->used = 1;
+        /* Keeps the table at most half full, so probe sequences stay short */
+        if (++shard->size * 2 > shard->capacity && resize(shard) != OK) {
+            /* The file is still in the table, only its growth failed */
+            if (shard->size == shard->capacity) {
+                slot->used = 0;
+                shard->size--;
+                status = ALLOC_FAILURE;
+            }
+        }
+    }
+    UNLOCK(shard);
+
+    return status;
+}
+
+long inode_set_size(InodeSet *set) {
+
+    long size = 0L;
+    int i;
+
+    for (i = 0; i < SHARDS; i++) {
+        LOCK(&(set->shards[i]));
+        size += set->shards[i].size;
+        UNLOCK(&(set->shards[i]));
+    }
+
+    return size;
+}
+
+void inode_set_destroy(InodeSet *set) {
+
+    int i;
+
+    if (set != NULL) {
+        for (i = 0; i < SHARDS; i++) {
+            free(set->shards[i].slots);
+            pthread_mutex_destroy(&(set->shards[i].lock));
+        }
+        free(set);
+    }
+}
@@ -0,0 +1,384 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+#include "mount_table.h"
+
+/* Location of the process' mount information */
+#define MOUNTINFO "/proc/self/mountinfo"
+
+/* Flags kept for each mount */
+#define REACHABLE 0x1           /* The mount point lies under a search path */
+#define DUPLICATE 0x2           /* The mount's subtree is crawled through another */
+
+/*
+ * A subtree of a filesystem that will be crawled, either from a search path or from
+ * a mount reachable under one.
+ */
+typedef struct {
+    uint64_t dev;               /* The device number of the filesystem */
+    char *root;                 /* The subtree's directory, relative to the filesystem */
+    long rank;                  /* Lower ranks are preferred over higher ones */
+    long mount;                 /* Index of the mount it is reached through */
+} Cover;
+
+/*
+ * The struct for the mount table ADT.
+ */
+struct mount_table {
+    MountInfo *mounts;          /* The mounts, sorted by ID */
+    long len;                   /* Number of mounts */
+    unsigned char *flags;       /* The flags of each mount */
+    Cover *covers;              /* The subtrees that will be crawled */
+    long nCovers;               /* Number of subtrees */
+    long coverCapacity;         /* Capacity of the covers array */
+    long nPaths;                /* Number of search paths added */
+};
+
+/*
+ * Used to sort the mounts by their IDs.
+ */
+static int compareIds(const void *a, const void *b) {
+
+    uint64_t x = ((const MountInfo *)a)->id, y = ((const MountInfo *)b)->id;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Decodes the octal escapes mountinfo uses for spaces, tabs, newlines and backslashes
+ * in paths (e.g. '\040'), in place.
+ */
+static void decodeField(char *field) {
+
+    char *in = field, *out = field;
+
+    while (*in != '\0') {
+        if (in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' &&
+            in[3] >= '0' && in[3] <= '7') {
+            *out++ = (char)(((in[1] - '0') << 6) | ((in[2] - '0') << 3) | (in[3] - '0'));
+            in += 4;
+        } else {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+}
+
+/*
+ * Parses a single line of mountinfo into 'mount'. The format is documented in proc(5):
+ *
+ *   36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+ *
+ * Returns 0 if successful, 1 if the line is malformed or allocation failed.
+ */
+static int parseLine(char *line, MountInfo *mount) {
+
+    unsigned long long id, parentId;
+    unsigned int major, minor;
+    char *save, *root, *mountPoint, *field;
+
+    if (sscanf(line, "%llu %llu %u:%u", &id, &parentId, &major, &minor) != 4)
+        return 1;
+
+    /* Skips over the ID, parent ID and device fields to the root and mount point */
+    if (strtok_r(line, " ", &save) == NULL || strtok_r(NULL, " ", &save) == NULL ||
+        strtok_r(NULL, " ", &save) == NULL)
+        return 1;
+    if ((root = strtok_r(NULL, " ", &save)) == NULL || (mountPoint = strtok_r(NULL, " ", &save)) == NULL)
+        return 1;
+    /* The optional fields end with a lone '-', followed by the filesystem type */
+    while ((field = strtok_r(NULL, " ", &save)) != NULL && strcmp(field, "-") != 0)
+        ;
+    if (field == NULL || (field = strtok_r(NULL, " ", &save)) == NULL)
+        return 1;
+    decodeField(root);
+    decodeField(mountPoint);
+    decodeField(field);
+
+    mount->id = id;
+    mount->parentId = parentId;
+    mount->dev = makedev(major, minor);
+    mount->root = strdup(root);
+    mount->mountPoint = strdup(mountPoint);
+    mount->fsType = strdup(field);
+    if (mount->root == NULL || mount->mountPoint == NULL || mount->fsType == NULL) {
+        free(mount->root);
+        free(mount->mountPoint);
+        free(mount->fsType);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns 1 if the directory 'dir' is 'root' or is somewhere underneath it.
+ */
+static int isWithin(const char *dir, const char *root) {
+
+    size_t len = strlen(root);
+
+    if (strcmp(root, "/") == 0)
+        return 1;
+    return strncmp(dir, root, len) == 0 && (dir[len] == '\0' || dir[len] == '/');
+}
+
+/*
+ * Returns 1 if the 'i'th mount is hidden by another mount on top of the same mount point.
+ */
+static int isHidden(const MountTable *table, long i) {
+
+    long j;
+
+    for (j = 0L; j < table->len; j++) {
+        if (table->mounts[j].parentId == table->mounts[i].id &&
+            strcmp(table->mounts[j].mountPoint, table->mounts[i].mountPoint) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Adds the subtree 'root' of the 'mount'th mount's filesystem, reached with the rank
+ * 'rank'. Takes ownership of 'root'. Returns 0 if successful, 1 if allocation failed.
+ */
+static int addCover(MountTable *table, long mount, char *root, long rank) {
+
+    /* Grows the covers array if it's full */
+    if (table->nCovers == table->coverCapacity) {
+        long capacity = (table->coverCapacity == 0L) ? 16L : 2 * table->coverCapacity;
+        Cover *covers = (Cover *)realloc(table->covers, capacity * sizeof(Cover));
+        if (covers == NULL) {
+            free(root);
+            return 1;
+        }
+        table->covers = covers;
+        table->coverCapacity = capacity;
+    }
+    table->covers[table->nCovers].dev = table->mounts[mount].dev;
+    table->covers[table->nCovers].root = root;
+    table->covers[table->nCovers].rank = rank;
+    table->covers[table->nCovers].mount = mount;
+    table->nCovers++;
+
+    return 0;
+}
+
+Status mount_table_new(MountTable **table) {
+
+    MountTable *temp;
+    FILE *fp;
+    char *line = NULL;
+    size_t size = 0;
+    long capacity = 64L;
+    Status status = OK;
+
+    if ((fp = fopen(MOUNTINFO, "r")) == NULL)
+        return NOT_FOUND;
+
+    /* Allocates the table and an initial array of mounts */
+    if ((temp = (MountTable *)malloc(sizeof(MountTable))) == NULL) {
+        fclose(fp);
+        return ALLOC_FAILURE;
+    }
+    temp->len = 0L;
+    temp->flags = NULL;
+    temp->covers = NULL;
+    temp->nCovers = 0L;
+    temp->coverCapacity = 0L;
+    temp->nPaths = 0L;
+    if ((temp->mounts = (MountInfo *)malloc(capacity * sizeof(MountInfo))) == NULL) {
+        status = ALLOC_FAILURE;
+        goto done;
+    }
+
+    /* Reads in each of the mounts, skipping any lines that cannot be parsed */
+    while (getline(&line, &size, fp) != -1) {
+        if (temp->len == capacity) {
+            MountInfo *mounts = (MountInfo *)realloc(temp->mounts, 2 * capacity * sizeof(MountInfo));
+            if (mounts == NULL) {
+                status = ALLOC_FAILURE;
+                goto done;
+            }
+            temp->mounts = mounts;
+            capacity *= 2;
+        }
+        if (parseLine(line, &(temp->mounts[temp->len])) == 0)
+            temp->len++;
+    }
+
+    qsort(temp->mounts, temp->len, sizeof(MountInfo), compareIds);
+    if ((temp->flags = (unsigned char *)calloc(temp->len + 1, sizeof(unsigned char))) == NULL)
+        status = ALLOC_FAILURE;
+
+/*
+ * Whether successful or not, jump here to close the file and
+ * clean up if anything went wrong
+ */
+done:
+    free(line);
+    fclose(fp);
+    if (status != OK)
+        mount_table_destroy(temp);
+    else
+        *table = temp;
+    return status;
+}
+
+const MountInfo *mount_table_find(MountTable *table, uint64_t id, uint64_t dev) {
+
+    long low = 0L, high = table->len - 1, mid;
+
+    /* Without a mount ID, falls back to the first mount of the device */
+    if (id == 0) {
+        for (mid = 0L; mid < table->len; mid++) {
+            if (table->mounts[mid].dev == dev)
+                return &(table->mounts[mid]);
+        }
+        return NULL;
+    }
+
+    while (low <= high) {
+        mid = low + (high - low) / 2;
+        if (table->mounts[mid].id == id)
+            return &(table->mounts[mid]);
+        if (table->mounts[mid].id < id)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+
+    return NULL;
+}
+
+Status mount_table_add_path(MountTable *table, const char *path) {
+
+    char *real, *root;
+    size_t len, best = 0;
+    long i, mount = -1L;
+
+    if ((real = realpath(path, NULL)) == NULL)
+        return NOT_FOUND;
+
+    /* The path is on the visible mount with the longest mount point above it */
+    for (i = 0L; i < table->len; i++) {
+        len = strlen(table->mounts[i].mountPoint);
+        if (isWithin(real, table->mounts[i].mountPoint) && (mount < 0L || len > best) && !isHidden(table, i)) {
+            mount = i;
+            best = len;
+        }
+    }
+    if (mount < 0L) {
+        free(real);
+        return NOT_FOUND;
+    }
+
+    /*
+     * Translates the path into a directory of the filesystem: the mount point is swapped
+     * for the directory the mount was made from
+     */
+    len = (strcmp(table->mounts[mount].mountPoint, "/") == 0) ? 0 : best;
+    if ((root = (char *)malloc(strlen(table->mounts[mount].root) + strlen(real + len) + 1)) == NULL) {
+        free(real);
+        return ALLOC_FAILURE;
+    }
+    strcpy(root, (strcmp(table->mounts[mount].root, "/") == 0 && real[len] != '\0') ? "" : table->mounts[mount].root);
+    strcat(root, real + len);
+
+    /* Each mount that can be reached under the path is crawled as well, unless a duplicate */
+    for (i = 0L; i < table->len; i++) {
+        if (isWithin(table->mounts[i].mountPoint, real) && !isHidden(table, i))
+            table->flags[i] |= REACHABLE;
+    }
+    free(real);
+
+    if (addCover(table, mount, root, table->nPaths) != 0)
+        return ALLOC_FAILURE;
+    table->nPaths++;
+    return OK;
+}
+
+Status mount_table_resolve(MountTable *table) {
+
+    const MountInfo *mount;
+    const Cover *cover;
+    long i, j, rank;
+    char *root;
+
+    /* Search paths are preferred, then the reachable mounts in order of their IDs */
+    for (i = 0L; i < table->len; i++) {
+        if (!(table->flags[i] & REACHABLE))
+            continue;
+        if ((root = strdup(table->mounts[i].root)) == NULL || addCover(table, i, root, table->nPaths + i) != 0)
+            return ALLOC_FAILURE;
+    }
+
+    /*
+     * A mount is a duplicate if its subtree lies within another subtree of the same
+     * filesystem that is crawled: one strictly containing it, or the same subtree
+     * reached with a lower rank
+     */
+    for (i = 0L; i < table->len; i++) {
+        mount = &(table->mounts[i]);
+        rank = (table->flags[i] & REACHABLE) ? table->nPaths + i : LONG_MAX;
+        for (j = 0L; j < table->nCovers; j++) {
+            cover = &(table->covers[j]);
+            if (cover->mount != i && cover->dev == mount->dev && isWithin(mount->root, cover->root) &&
+                (strcmp(mount->root, cover->root) != 0 || cover->rank < rank)) {
+                table->flags[i] |= DUPLICATE;
+                break;
+            }
+        }
+    }
+
+    return OK;
+}
+
+Boolean mount_table_is_duplicate(const MountTable *table, const MountInfo *mount) {
+    return (table->flags[mount - table->mounts] & DUPLICATE) ? TRUE : FALSE;
+}
+
+void mount_table_destroy(MountTable *table) {
+
+    long i;
+
+    if (table != NULL) {
+        for (i = 0L; i < table->len; i++) {
+            free(table->mounts[i].root);
+            free(table->mounts[i].mountPoint);
+            free(table->mounts[i].fsType);
+        }
+        for (i = 0L; i < table->nCovers; i++)
+            free(table->covers[i].root);
+        free(table->mounts);
+        free(table->flags);
+        free(table->covers);
+        free(table);
+    }
+}
@@ -25,21 +25,19 @@
 #include <stdlib.h>
 #include "queue.h"
 
-/*
- * Struct for a node inside the queue.
- */
-typedef struct node {
-    struct node *next;  /* Points to the next node */
-    void *data;         /* Pointer that holds the element */
-} Node;
+/* Number of slots the queue's array starts out with once an item is added */
+#define INITIAL_CAPACITY 16L
 
 /*
- * The struct for the queue ADT.
+ * The struct for the queue ADT. The items are kept in a circular array, from 'head' on,
+ * wrapping around to the start of the array. The array grows as needed, but never
+ * shrinks; once polled, its slots are reused by the items added next.
  */
 struct queue {
-    Node *head;         /* Pointer to the queue's head */
-    Node *tail;         /* Pointer to the queue's tail */
+    void **items;       /* The circular array of items */
+    long head;          /* Index of the queue's head */
     long size;          /* The queue's current size */
+    long capacity;      /* The number of slots in the array (0, or a power of 2) */
 };
 
 Status queue_new(Queue **queue) {
@@ -49,10 +47,11 @@ Status queue_new(Queue **queue) {
     if (temp == NULL)
         return ALLOC_FAILURE;
 
-    /* Initializes the remaining struct members */
-    temp->head = NULL;
-    temp->tail = NULL;
+    /* Initializes the remaining struct members; the array is allocated on the first add */
+    temp->items = NULL;
+    temp->head = 0L;
     temp->size = 0L;
+    temp->capacity = 0L;
     *queue = temp;
 
     return OK;
@@ -60,23 +59,46 @@ Status queue_new(Queue **queue) {
 
 /* Macro to check if the queue is currently empty */
 #define IS_EMPTY(x)  ( ((x)->size == 0L) ? TRUE : FALSE )
+/* Macro for the slot of the queue's 'i'th item */
+#define SLOT(x, i)   ( (x)->items[((x)->head + (i)) & ((x)->capacity - 1L)] )
+
+/*
+ * Grows the queue's array until it holds at least 'capacity' items, moving the items
+ * to the start of the new array. Returns OK if successful, ALLOC_FAILURE if not.
+ */
+static Status ensureCapacity(Queue *queue, long capacity) {
+
+    long size = (queue->capacity > 0L) ? queue->capacity : INITIAL_CAPACITY;
+    void **items;
+    long i;
+
+    if (capacity <= queue->capacity)
+        return OK;
+    while (size < capacity)
+        size <<= 1;
+    items = (void **)malloc(size * sizeof(void *));
+    if (items == NULL)
+        return ALLOC_FAILURE;
+
+    /* Unwraps the items into the new array */
+    for (i = 0L; i < queue->size; i++)
+        items[i] = SLOT(queue, i);
+    free(queue->items);
+    queue->items = items;
+    queue->head = 0L;
+    queue->capacity = size;
+
+    return OK;
+}
 
 Status queue_add(Queue *queue, void *item) {
 
-    /* Allocate the node for item insertion */
-    Node *node = (Node *)malloc(sizeof(Node));
-    if (node == NULL)
+    /* Grows the array if it's full */
+    if (queue->size == queue->capacity && ensureCapacity(queue, queue->size + 1L) != OK)
         return ALLOC_FAILURE;
-    node->next = NULL;
-    node->data = item;
 
-    /* Edge case: queue is empty, link the front and rear nodes */
-    if (IS_EMPTY(queue) == TRUE)
-        queue->head = node;
-    /* Otherwise, links to the rear node */
-    else
-        queue->tail->next = node;
-    queue->tail = node;
+    /* Places the item in the slot after the rear item */
+    SLOT(queue, queue->size) = item;
     queue->size++;
 
     return OK;
@@ -88,7 +110,7 @@ Status queue_peek(Queue *queue, void **first) {
     if (IS_EMPTY(queue) == TRUE)
         return STRUCT_EMPTY;
     /* Extract the element, saves to pointer */
-    *first = queue->head->data;
+    *first = queue->items[queue->head];
 
     return OK;
 }
@@ -99,45 +121,67 @@ Status queue_poll(Queue *queue, void **first) {
     if (IS_EMPTY(queue) == TRUE)
         return STRUCT_EMPTY;
 
-    /* Unlink the head node from the queue */
-    Node *temp = queue->head;
-    queue->head = temp->next;
+    /* Takes the head item, the next item becomes the head */
+    *first = queue->items[queue->head];
+    queue->head = (queue->head + 1L) & (queue->capacity - 1L);
     queue->size--;
-    /* Edge case: one item, nullify both head and tail pointers */
-    if (IS_EMPTY(queue) == TRUE) {
-        queue->head = NULL;
-        queue->tail = NULL;
-    }
-    /* Free the allocated node's struct */
-    *first = temp->data;
-    free(temp);
 
     return OK;
 }
 
+long queue_splice(Queue *queue, Queue *other, long max) {
+
+    void **items;
+    long n, i, capacity;
+
+    n = (max < 0L || max >= other->size) ? other->size : max;
+    if (n == 0L)
+        return 0L;
+
+    /* Moving all into an empty queue, the arrays trade places */
+    if (IS_EMPTY(queue) == TRUE && n == other->size) {
+        items = queue->items;
+        capacity = queue->capacity;
+        queue->items = other->items;
+        queue->head = other->head;
+        queue->capacity = other->capacity;
+        other->items = items;
+        other->head = 0L;
+        other->capacity = capacity;
+        queue->size = n;
+        other->size = 0L;
+        return n;
+    }
+
+    /* Otherwise, copies the items over in order */
+    if (ensureCapacity(queue, queue->size + n) != OK)
+        return 0L;
+    for (i = 0L; i < n; i++)
+        SLOT(queue, queue->size + i) = SLOT(other, i);
+    queue->size += n;
+    other->head = (other->head + n) & (other->capacity - 1L);
+    other->size -= n;
+
+    return n;
+}
+
 /*
- * Clears out the queue of all its elements. Frees up all reserved memory
- * back to the heap.
+ * Clears out the queue of all its elements, invoking 'destructor' on each one if it's
+ * not NULL. The array is kept for reuse.
  */
 static void clearQueue(Queue *queue, void (*destructor)(void *)) {
 
-    Node *curr = queue->head, *next = NULL;
     long i;
 
-    for (i = 0L; i < queue->size; i++) {
-        next = curr->next;
-        /* Frees the allocated memory */
-        if (destructor != NULL)
-            (*destructor)(curr->data);
-        free(curr);
-        curr = next;
+    if (destructor != NULL) {
+        for (i = 0L; i < queue->size; i++)
+            (*destructor)(SLOT(queue, i));
     }
 }
 
 void queue_clear(Queue *queue, void (*destructor)(void *)) {
     clearQueue(queue, destructor);
-    queue->head = NULL;
-    queue->tail = NULL;
+    queue->head = 0L;
     queue->size = 0L;
 }
 
@@ -154,8 +198,7 @@ Boolean queue_isEmpty(Queue *queue) {
  */
 static void **generateArray(Queue *queue) {
 
-    Node *temp = NULL;
-    long i = 0L;
+    long i;
     size_t bytes;
     void **items = NULL;
 
@@ -166,8 +209,8 @@ static void **generateArray(Queue *queue) {
         return NULL;
 
     /* Populates the array with the queue items */
-    for (temp = queue->head; temp != NULL; temp = temp->next)
-        items[i++] = temp->data;
+    for (i = 0L; i < queue->size; i++)
+        items[i] = SLOT(queue, i);
 
     return items;
 }
@@ -224,5 +267,6 @@ Status queue_iterator(Queue *queue, Iterator **iter) {
 
 void queue_destroy(Queue *queue, void (*destructor)(void *)) {
     clearQueue(queue, destructor);
+    free(queue->items);
     free(queue);
 }
@@ -24,6 +24,8 @@
 
 #include <regex.h>
 #include <stdlib.h>
+#include <string.h>
+#include "glob_matcher.h"
 #include "regex_engine.h"
 
 #define DEFAULT_MAX 128
@@ -37,6 +39,16 @@ struct regex_engine {
     regex_t exp;
     RegexState state;
     int compStatus;
+    int maxLen;
+    char *pattern;          /* The pattern compiled, compiled again by each context */
+    int flags;              /* The flags it was compiled with */
+    GlobMatcher *glob;      /* The bash patterns matched without a regex, or NULL */
+};
+
+struct regex_context {
+    const RegexEngine *regex;   /* The engine matched with */
+    regex_t exp;                /* The context's own compile of the engine's regex */
+    RegexState state;
     int execStatus;
     int len;
     int maxLen;
@@ -46,79 +58,151 @@ struct regex_engine {
 RegexEngine *regex_engine_new(int max) {
 
     RegexEngine *re;
-    RegexMatch *temp;
-    int maxMatches;
 
     if ((re = (RegexEngine *)malloc(sizeof(RegexEngine))) != NULL) {
-
-        maxMatches = (max <= 0) ? DEFAULT_MAX : max;
-        if ((temp = (RegexMatch *)malloc(sizeof(RegexMatch) * maxMatches)) != NULL) {
-            re->state = ALLOCATED;
-            re->compStatus = 0;
-            re->execStatus = 0;
-            re->len = 0;
-            re->maxLen = maxMatches;
-            re->matches = temp;
-        } else {
-            free(re);
-            re = NULL;
-        }
+        re->state = ALLOCATED;
+        re->compStatus = 0;
+        re->maxLen = (max <= 0) ? DEFAULT_MAX : max;
+        re->pattern = NULL;
+        re->flags = 0;
+        re->glob = NULL;
     }
 
     return re;
 }
 
-int regex_engine_compile_pattern(RegexEngine *regex, const char *pattern, int flags) {
-
-    int status = 0;
+/*
+ * Drops the regex or bash patterns compiled into 'regex' so far.
+ */
+static void regex_engine_reset(RegexEngine *regex) {
 
     if (regex->state == COMPILED) {
         regfree(&(regex->exp));
         regex->state = ALLOCATED;
     }
+    free(regex->pattern);
+    regex->pattern = NULL;
+    glob_matcher_destroy(regex->glob);
+    regex->glob = NULL;
+}
+
+int regex_engine_compile_pattern(RegexEngine *regex, const char *pattern, int flags) {
+
+    int status = 0;
+
+    regex_engine_reset(regex);
 
     regex->compStatus = regcomp(&(regex->exp), pattern, flags);
     if (regex->compStatus) {
         status = CMP_FAIL;
+    } else if ((regex->pattern = strdup(pattern)) == NULL) {
+        regfree(&(regex->exp));
+        regex->compStatus = REG_ESPACE;
+        status = CMP_FAIL;
     } else {
+        regex->flags = flags;
         regex->state = COMPILED;
     }
 
     return status;
 }
 
-int regex_engine_isMatch(RegexEngine *regex, const char *str) {
+int regex_engine_add_glob(RegexEngine *regex, const char *glob, int flags) {
+
+    if (regex->state == COMPILED)
+        regex_engine_reset(regex);
+
+    if (regex->glob == NULL && glob_matcher_new(&(regex->glob), (flags & REG_ICASE) != 0) != OK)
+        return CMP_FAIL;
+    return (glob_matcher_add(regex->glob, glob) == 0) ? 0 : CMP_FAIL;
+}
+
+int regex_engine_error(RegexEngine *regex, char buffer[], size_t size) {
+
+    int status = NO_ERROR;
+    if (regex->compStatus) {
+        regerror(regex->compStatus, &(regex->exp), buffer, size);
+        status = 0;
+    }
+
+    return status;
+}
+
+void destroy_regex_engine(RegexEngine *regex) {
+
+    if (regex != NULL) {
+        regex_engine_reset(regex);
+        free(regex);
+    }
+}
+
+RegexContext *regex_context_new(const RegexEngine *regex) {
+
+    RegexContext *ctx;
+    RegexMatch *temp;
+
+    if ((ctx = (RegexContext *)malloc(sizeof(RegexContext))) != NULL) {
+
+        if ((temp = (RegexMatch *)malloc(sizeof(RegexMatch) * regex->maxLen)) != NULL) {
+            ctx->regex = regex;
+            ctx->state = ALLOCATED;
+            ctx->execStatus = 0;
+            ctx->len = 0;
+            ctx->maxLen = regex->maxLen;
+            ctx->matches = temp;
+            /* The engine already compiled the same pattern, so this only fails for lack of memory */
+            if (regex->state == COMPILED) {
+                if (regcomp(&(ctx->exp), regex->pattern, regex->flags) == 0) {
+                    ctx->state = COMPILED;
+                } else {
+                    free(temp);
+                    free(ctx);
+                    ctx = NULL;
+                }
+            }
+        } else {
+            free(ctx);
+            ctx = NULL;
+        }
+    }
+
+    return ctx;
+}
+
+int regex_context_isMatch(RegexContext *context, const char *str) {
 
     int status = 0;
-    regmatch_t match[1];
 
-    if (regex->state == COMPILED) {
-        regex->execStatus = regexec(&(regex->exp), str, 1, match, 0);
-        status = (!regex->execStatus) ? 1 : 0;
+    if (context->regex->glob != NULL) {
+        status = glob_matcher_isMatch(context->regex->glob, str);
+    } else if (context->state == COMPILED) {
+        /* Without any match to report, the search stops at the first match it finds */
+        context->execStatus = regexec(&(context->exp), str, 0, NULL, 0);
+        status = (!context->execStatus) ? 1 : 0;
     }
 
     return status;
 }
 
-int regex_engine_execute(RegexEngine *regex, const char *str) {
+int regex_context_execute(RegexContext *context, const char *str) {
 
     int status = NO_CMP;
 
-    if (regex->state == COMPILED) {
+    if (context->state == COMPILED) {
 
-        regmatch_t matches[regex->maxLen];
-        regex->execStatus = regexec(&(regex->exp), str, regex->maxLen, matches, 0);
-        if (regex->execStatus) {
+        regmatch_t matches[context->maxLen];
+        context->execStatus = regexec(&(context->exp), str, context->maxLen, matches, 0);
+        if (context->execStatus) {
             status = NO_MATCH;
         } else {
             int i;
-            for (i = 0; i < regex->maxLen; i++) {
+            for (i = 0; i < context->maxLen; i++) {
                 if (matches[i].rm_so == -1)
                     break;
-                regex->matches[i].start = matches[i].rm_so;
-                regex->matches[i].end = matches[i].rm_eo;
+                context->matches[i].start = matches[i].rm_so;
+                context->matches[i].end = matches[i].rm_eo;
             }
-            regex->len = i;
+            context->len = i;
             status = 0;
         }
     }
@@ -126,38 +210,24 @@ int regex_engine_execute(RegexEngine *regex, const char *str) {
     return status;
 }
 
-int regex_engine_getMatches(RegexEngine *regex, RegexMatch **matches, int *len) {
+int regex_context_getMatches(RegexContext *context, RegexMatch **matches, int *len) {
 
     int status = NO_MATCH;
-    if (!regex->execStatus || regex->len == 0) {
-        *matches = regex->matches;
-        *len = regex->len;
+    if (!context->execStatus || context->len == 0) {
+        *matches = context->matches;
+        *len = context->len;
         status = 0;
     }
 
     return status;
 }
 
-int regex_engine_error(RegexEngine *regex, char buffer[], size_t size) {
+void regex_context_destroy(RegexContext *context) {
 
-    int status = NO_ERROR;
-    if (regex->compStatus) {
-        regerror(regex->compStatus, &(regex->exp), buffer, size);
-        status = 0;
-    } else if (regex->execStatus) {
-        regerror(regex->execStatus, &(regex->exp), buffer, size);
-        status = 0;
-    }
-
-    return status;
-}
-
-void destroy_regex_engine(RegexEngine *regex) {
-
-    if (regex != NULL) {
-        if (regex->state == COMPILED)
-            regfree(&(regex->exp));
-        free(regex->matches);
-        free(regex);
+    if (context != NULL) {
+        if (context->state == COMPILED)
+            regfree(&(context->exp));
+        free(context->matches);
+        free(context);
     }
 }
@@ -0,0 +1,307 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "slab.h"
+
+/* Granularity of the size classes, also the alignment of every block */
+#define SLAB_ALIGN 16UL
+/* Size of the chunks blocks are carved from */
+#define CHUNK_SIZE 65536UL
+/* Number of blocks a thread keeps on its list for a class before giving half back */
+#define CACHE_MAX 256L
+
+/*
+ * A free block, linked to the next one on its list.
+ */
+typedef struct block {
+    struct block *next;
+} Block;
+
+/*
+ * A list of free blocks of a size class.
+ */
+typedef struct {
+    Block *head;                /* The first block on the list */
+    long count;                 /* Number of blocks on the list */
+} FreeList;
+
+/*
+ * The header of a chunk, padded so that the blocks carved after it are aligned.
+ */
+typedef union chunk {
+    union chunk *next;          /* The chunk allocated before this one */
+    char pad[SLAB_ALIGN];
+} Chunk;
+
+/*
+ * The blocks kept by a single thread: a list per size class, and the rest of the chunk
+ * it's carving new blocks from.
+ */
+typedef struct {
+    Slab *slab;                 /* The slab the cache belongs to */
+    char *chunk;                /* Where the next block is carved from */
+    size_t left;                /* Number of bytes left in the chunk */
+    FreeList lists[];           /* The thread's free blocks of each class */
+} Cache;
+
+/*
+ * Struct for the slab.
+ */
+struct slab {
+    int nClasses;               /* Number of size classes */
+    pthread_key_t key;          /* Each thread's cache */
+    pthread_mutex_t lock;       /* Guards the chunks and the shared lists */
+    Chunk *chunks;              /* Every chunk allocated, newest first */
+    atomic_long *shared;        /* Number of blocks on each shared list, read without the lock */
+    FreeList lists[];           /* The free blocks shared by all threads, by class */
+};
+
+/*
+ * Moves the blocks of 'list' onto the front of 'dest'.
+ */
+static void splice_list(FreeList *dest, FreeList *list) {
+
+    Block *tail;
+
+    if (list->head == NULL)
+        return;
+    for (tail = list->head; tail->next != NULL; tail = tail->next)
+        ;
+    tail->next = dest->head;
+    dest->head = list->head;
+    dest->count += list->count;
+    list->head = NULL;
+    list->count = 0L;
+}
+
+/*
+ * Moves up to 'n' blocks from the front of 'list' onto the front of 'dest'.
+ */
+static void move_blocks(FreeList *dest, FreeList *list, long n) {
+
+    FreeList taken = {list->head, 0L};
+    Block *tail = NULL;
+
+    while (taken.count < n && list->head != NULL) {
+        tail = list->head;
+        list->head = tail->next;
+        list->count--;
+        taken.count++;
+    }
+    if (tail != NULL) {
+        tail->next = NULL;
+        splice_list(dest, &taken);
+    }
+}
+
+/*
+ * Publishes the number of blocks on the shared list of the 'i'th class, once changed
+ * under the lock, so threads can tell whether it's worth locking to take any.
+ */
+static void publish_count(Slab *slab, int i) {
+    atomic_store_explicit(&(slab->shared[i]), slab->lists[i].count, memory_order_relaxed);
+}
+
+/*
+ * Gives the blocks kept by an exiting thread back to its slab's shared lists. This is
+ * the destructor of the key the caches are held by.
+ */
+static void release_cache(void *arg) {
+
+    Cache *cache = (Cache *)arg;
+    Slab *slab = cache->slab;
+    int i;
+
+    (void)pthread_mutex_lock(&(slab->lock));
+    for (i = 0; i < slab->nClasses; i++) {
+        splice_list(&(slab->lists[i]), &(cache->lists[i]));
+        publish_count(slab, i);
+    }
+    (void)pthread_mutex_unlock(&(slab->lock));
+    free(cache);
+}
+
+/*
+ * Returns the calling thread's cache, creating it on its first call. Returns NULL if
+ * allocation failed.
+ */
+static Cache *get_cache(Slab *slab) {
+
+    Cache *cache = (Cache *)pthread_getspecific(slab->key);
+
+    if (cache == NULL) {
+        if ((cache = (Cache *)calloc(1, sizeof(Cache) + (size_t)slab->nClasses * sizeof(FreeList))) == NULL)
+            return NULL;
+        cache->slab = slab;
+        if (pthread_setspecific(slab->key, cache) != 0) {
+            free(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+/*
+ * Carves a new block of 'size' bytes from the cache's chunk, starting a new chunk once
+ * it runs out. Returns the block, or NULL if allocation failed.
+ */
+static void *carve_block(Slab *slab, Cache *cache, size_t size) {
+
+    Chunk *chunk;
+    void *block;
+
+    /* What's left of the old chunk is too small, and is left unused */
+    if (cache->left < size) {
+        if ((chunk = (Chunk *)malloc(CHUNK_SIZE)) == NULL)
+            return NULL;
+        (void)pthread_mutex_lock(&(slab->lock));
+        chunk->next = slab->chunks;
+        slab->chunks = chunk;
+        (void)pthread_mutex_unlock(&(slab->lock));
+        cache->chunk = (char *)(chunk + 1);
+        cache->left = CHUNK_SIZE - sizeof(Chunk);
+    }
+
+    block = cache->chunk;
+    cache->chunk += size;
+    cache->left -= size;
+    return block;
+}
+
+Status slab_new(Slab **slab, size_t maxSize) {
+
+    Slab *temp;
+    int nClasses = (int)((maxSize + SLAB_ALIGN - 1UL) / SLAB_ALIGN);
+
+    if ((temp = (Slab *)calloc(1, sizeof(Slab) + (size_t)nClasses * sizeof(FreeList))) == NULL)
+        return ALLOC_FAILURE;
+    if ((temp->shared = (atomic_long *)calloc((size_t)nClasses, sizeof(atomic_long))) == NULL) {
+        free(temp);
+        return ALLOC_FAILURE;
+    }
+    if (pthread_key_create(&(temp->key), release_cache) != 0) {
+        free(temp->shared);
+        free(temp);
+        return ALLOC_FAILURE;
+    }
+
+    temp->nClasses = nClasses;
+    temp->chunks = NULL;
+    (void)pthread_mutex_init(&(temp->lock), NULL);
+    *slab = temp;
+
+    return OK;
+}
+
+void *slab_alloc(Slab *slab, size_t size) {
+
+    int i = (int)((size + SLAB_ALIGN - 1UL) / SLAB_ALIGN) - 1;
+    Cache *cache;
+    FreeList *list;
+    Block *block;
+
+    /* Zero-sized blocks still take the smallest class, so each has an address of its own */
+    if (i < 0)
+        i = 0;
+    if (i >= slab->nClasses)
+        return malloc(size);
+    if ((cache = get_cache(slab)) == NULL)
+        return NULL;
+
+    list = &(cache->lists[i]);
+    /* Once the thread's own list runs dry, it takes a batch from the shared list */
+    if (list->head == NULL && atomic_load_explicit(&(slab->shared[i]), memory_order_relaxed) > 0L) {
+        (void)pthread_mutex_lock(&(slab->lock));
+        move_blocks(list, &(slab->lists[i]), CACHE_MAX / 2L);
+        publish_count(slab, i);
+        (void)pthread_mutex_unlock(&(slab->lock));
+    }
+    if ((block = list->head) == NULL)
+        return carve_block(slab, cache, (size_t)(i + 1) * SLAB_ALIGN);
+
+    list->head = block->next;
+    list->count--;
+    return block;
+}
+
+void slab_free(Slab *slab, void *block, size_t size) {
+
+    int i = (int)((size + SLAB_ALIGN - 1UL) / SLAB_ALIGN) - 1;
+    Cache *cache;
+    FreeList *list;
+
+    if (i < 0)
+        i = 0;
+    if (i >= slab->nClasses) {
+        free(block);
+        return;
+    }
+
+    /* Without a cache of its own, the thread puts the block straight on the shared list */
+    if ((cache = get_cache(slab)) == NULL) {
+        (void)pthread_mutex_lock(&(slab->lock));
+        list = &(slab->lists[i]);
+        ((Block *)block)->next = list->head;
+        list->head = (Block *)block;
+        list->count++;
+        publish_count(slab, i);
+        (void)pthread_mutex_unlock(&(slab->lock));
+        return;
+    }
+
+    list = &(cache->lists[i]);
+    ((Block *)block)->next = list->head;
+    list->head = (Block *)block;
+    /* A thread that frees more than it allocates gives half its blocks to the others */
+    if (++list->count > CACHE_MAX) {
+        (void)pthread_mutex_lock(&(slab->lock));
+        move_blocks(&(slab->lists[i]), list, CACHE_MAX / 2L);
+        publish_count(slab, i);
+        (void)pthread_mutex_unlock(&(slab->lock));
+    }
+}
+
+void slab_destroy(Slab *slab) {
+
+    Cache *cache = (Cache *)pthread_getspecific(slab->key);
+    Chunk *chunk;
+
+    /* Every other thread gave its cache back as it exited */
+    if (cache != NULL) {
+        (void)pthread_setspecific(slab->key, NULL);
+        free(cache);
+    }
+    (void)pthread_key_delete(slab->key);
+    while ((chunk = slab->chunks) != NULL) {
+        slab->chunks = chunk->next;
+        free(chunk);
+    }
+    (void)pthread_mutex_destroy(&(slab->lock));
+    free(slab->shared);
+    free(slab);
+}
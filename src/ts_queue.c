@@ -0,0 +1,377 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "queue.h"
+#include "ts_queue.h"
+
+/* Smallest number of slots in the ring */
+#define MIN_CAPACITY 2L
+/* Size of a cache line, kept between the ends of the ring */
+#define CACHE_LINE 64
+
+/*
+ * A slot of the ring. Its sequence tells which turn around the ring the slot is on, and
+ * whether it's waiting for an item or holds one (Vyukov's bounded MPMC queue).
+ */
+typedef struct {
+    atomic_long seq;            /* Index the slot is next added at, plus 1 once it's filled */
+    _Atomic(void *) item;       /* The item held in the slot */
+} Cell;
+
+/*
+ * Struct for the thread-safe queue. The items are those in the ring from 'head' up to,
+ * but not including, 'tail', followed by those in the overflow queue.
+ */
+struct ts_queue {
+    atomic_long head;           /* Index of the next item to poll from the ring */
+    char pad1[CACHE_LINE];      /* Keeps the polling threads off the adding threads' line */
+    atomic_long tail;           /* Index of the next slot to add to in the ring */
+    char pad2[CACHE_LINE];      /* Keeps the ends off the rest of the struct */
+    atomic_long nOverflow;      /* Number of items in the overflow queue */
+    pthread_mutex_t lock;       /* The lock on the overflow queue */
+    Queue *overflow;            /* Items added while the ring was full */
+    long mask;                  /* The number of slots, less one (a power of 2) */
+    Cell *cells;                /* The ring's slots */
+};
+
+/* Macro used for locking the overflow queue */
+#define LOCK(x)    pthread_mutex_lock( &((x)->lock) )
+/* Macro used for unlocking the overflow queue */
+#define UNLOCK(x)  pthread_mutex_unlock( &((x)->lock) )
+
+Status ts_queue_new(ConcurrentQueue **queue, long capacity) {
+
+    ConcurrentQueue *temp;
+    pthread_mutexattr_t attr;
+    long size = MIN_CAPACITY, i;
+
+    while (size < capacity)
+        size <<= 1;
+
+    /* Allocates memory for the queue and its ring */
+    if ((temp = (ConcurrentQueue *)malloc(sizeof(ConcurrentQueue))) == NULL)
+        return ALLOC_FAILURE;
+    if ((temp->cells = (Cell *)malloc(size * sizeof(Cell))) == NULL) {
+        free(temp);
+        return ALLOC_FAILURE;
+    }
+    if (queue_new(&(temp->overflow)) != OK) {
+        free(temp->cells);
+        free(temp);
+        return ALLOC_FAILURE;
+    }
+
+    /* Each slot starts out waiting for the item added on the first turn */
+    for (i = 0L; i < size; i++) {
+        atomic_init(&(temp->cells[i].seq), i);
+        atomic_init(&(temp->cells[i].item), NULL);
+    }
+    atomic_init(&(temp->head), 0L);
+    atomic_init(&(temp->tail), 0L);
+    atomic_init(&(temp->nOverflow), 0L);
+    temp->mask = size - 1L;
+
+    /* Creates the pthread_mutex for locking */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(temp->lock), &attr);
+    pthread_mutexattr_destroy(&attr);
+    *queue = temp;
+
+    return OK;
+}
+
+/*
+ * Adds the item 'item' to the ring. Returns OK if successful, STRUCT_FULL if the ring
+ * is full.
+ */
+static Status ring_add(ConcurrentQueue *queue, void *item) {
+
+    long pos = atomic_load_explicit(&(queue->tail), memory_order_relaxed);
+    long diff;
+    Cell *cell;
+
+    for (;;) {
+        cell = &(queue->cells[pos & queue->mask]);
+        diff = atomic_load_explicit(&(cell->seq), memory_order_acquire) - pos;
+        if (diff == 0L) {
+            /* The slot is free on this turn, claim it */
+            if (atomic_compare_exchange_weak_explicit(&(queue->tail), &pos, pos + 1L,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0L) {
+            /* The slot still holds the item from the last turn */
+            return STRUCT_FULL;
+        } else {
+            pos = atomic_load_explicit(&(queue->tail), memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&(cell->item), item, memory_order_relaxed);
+    atomic_store_explicit(&(cell->seq), pos + 1L, memory_order_release);
+
+    return OK;
+}
+
+/*
+ * Removes the first item in the ring into '*item'. Returns OK if successful,
+ * STRUCT_EMPTY if the ring is empty.
+ */
+static Status ring_poll(ConcurrentQueue *queue, void **item) {
+
+    long pos = atomic_load_explicit(&(queue->head), memory_order_relaxed);
+    long diff;
+    Cell *cell;
+
+    for (;;) {
+        cell = &(queue->cells[pos & queue->mask]);
+        diff = atomic_load_explicit(&(cell->seq), memory_order_acquire) - (pos + 1L);
+        if (diff == 0L) {
+            /* The slot holds this turn's item, claim it */
+            if (atomic_compare_exchange_weak_explicit(&(queue->head), &pos, pos + 1L,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0L) {
+            /* The slot has yet to be filled on this turn */
+            return STRUCT_EMPTY;
+        } else {
+            pos = atomic_load_explicit(&(queue->head), memory_order_relaxed);
+        }
+    }
+    *item = atomic_load_explicit(&(cell->item), memory_order_relaxed);
+    /* Frees the slot for the next turn around the ring */
+    atomic_store_explicit(&(cell->seq), pos + queue->mask + 1L, memory_order_release);
+
+    return OK;
+}
+
+/*
+ * Moves as many items from the front of the overflow queue into the ring as it can
+ * hold. Until the overflow queue is empty, new items are added behind it, so the order
+ * is kept. Must hold the lock.
+ */
+static void refill(ConcurrentQueue *queue) {
+
+    void *item;
+
+    while (queue_peek(queue->overflow, &item) == OK && ring_add(queue, item) == OK) {
+        (void)queue_poll(queue->overflow, &item);
+        atomic_fetch_sub(&(queue->nOverflow), 1L);
+    }
+}
+
+Status ts_queue_add(ConcurrentQueue *queue, void *item) {
+
+    Status status = OK;
+
+    /* Items only go to the ring while nothing is waiting in the overflow queue */
+    if (atomic_load(&(queue->nOverflow)) == 0L && ring_add(queue, item) == OK)
+        return OK;
+
+    LOCK(queue);
+    if (atomic_load(&(queue->nOverflow)) != 0L || ring_add(queue, item) != OK) {
+        if ((status = queue_add(queue->overflow, item)) == OK)
+            atomic_fetch_add(&(queue->nOverflow), 1L);
+    }
+    UNLOCK(queue);
+
+    return status;
+}
+
+Status ts_queue_peek(ConcurrentQueue *queue, void **first) {
+
+    long pos;
+    Status status;
+    Cell *cell;
+
+    /* The first item counts only if it's still first once it's been read */
+    do {
+        pos = atomic_load_explicit(&(queue->head), memory_order_acquire);
+        cell = &(queue->cells[pos & queue->mask]);
+        if (atomic_load_explicit(&(cell->seq), memory_order_acquire) != pos + 1L)
+            break;
+        *first = atomic_load_explicit(&(cell->item), memory_order_relaxed);
+        if (atomic_load_explicit(&(queue->head), memory_order_acquire) == pos)
+            return OK;
+    } while (1);
+
+    if (atomic_load(&(queue->nOverflow)) == 0L)
+        return STRUCT_EMPTY;
+    LOCK(queue);
+    status = queue_peek(queue->overflow, first);
+    UNLOCK(queue);
+
+    return status;
+}
+
+Status ts_queue_poll(ConcurrentQueue *queue, void **first) {
+
+    Status status;
+
+    if (ring_poll(queue, first) == OK)
+        return OK;
+    if (atomic_load(&(queue->nOverflow)) == 0L)
+        return STRUCT_EMPTY;
+
+    /* The ring ran dry with items left over, move them in; others may poll them first */
+    LOCK(queue);
+    do {
+        refill(queue);
+        status = ring_poll(queue, first);
+    } while (status != OK && atomic_load(&(queue->nOverflow)) != 0L);
+    UNLOCK(queue);
+
+    return status;
+}
+
+void ts_queue_clear(ConcurrentQueue *queue, void (*destructor)(void *)) {
+
+    void *item;
+
+    while (ts_queue_poll(queue, &item) == OK) {
+        if (destructor != NULL)
+            destructor(item);
+    }
+}
+
+long ts_queue_size(ConcurrentQueue *queue) {
+
+    long head = atomic_load(&(queue->head));
+    long size = atomic_load(&(queue->tail)) - head;
+
+    /* A slot claimed but not yet filled is counted; one claimed for polling is not */
+    if (size < 0L)
+        size = 0L;
+    return size + atomic_load(&(queue->nOverflow));
+}
+
+Boolean ts_queue_isEmpty(ConcurrentQueue *queue) {
+    return ( ts_queue_size(queue) == 0L ) ? TRUE : FALSE;
+}
+
+/*
+ * Generates an array of the items in the queue into '*items', storing its length into
+ * '*len'. Returns OK if successful, STRUCT_EMPTY if the queue is empty, ALLOC_FAILURE
+ * if the array could not be allocated. Must hold the lock.
+ */
+static Status generate_array(ConcurrentQueue *queue, void ***items, long *len) {
+
+    long head = atomic_load(&(queue->head));
+    long tail = atomic_load(&(queue->tail));
+    long pos, n = 0L;
+    void **temp, *item;
+    Iterator *iter;
+    Cell *cell;
+
+    if (tail - head + queue_size(queue->overflow) <= 0L)
+        return STRUCT_EMPTY;
+    if ((temp = (void **)malloc((tail - head + queue_size(queue->overflow)) * sizeof(void *))) == NULL)
+        return ALLOC_FAILURE;
+
+    /*
+     * Slots emptied or refilled since the ends were read are skipped. The item counts
+     * only if the slot held it for this turn both before and after it was read.
+     */
+    for (pos = head; pos < tail; pos++) {
+        cell = &(queue->cells[pos & queue->mask]);
+        if (atomic_load_explicit(&(cell->seq), memory_order_acquire) != pos + 1L)
+            continue;
+        item = atomic_load_explicit(&(cell->item), memory_order_acquire);
+        if (atomic_load_explicit(&(cell->seq), memory_order_relaxed) == pos + 1L)
+            temp[n++] = item;
+    }
+    if (queue_iterator(queue->overflow, &iter) == OK) {
+        while (iterator_next(iter, &item) == OK)
+            temp[n++] = item;
+        iterator_destroy(iter);
+    }
+
+    if (n == 0L) {
+        free(temp);
+        return STRUCT_EMPTY;
+    }
+    *items = temp;
+    *len = n;
+
+    return OK;
+}
+
+Status ts_queue_toArray(ConcurrentQueue *queue, Array **array) {
+
+    void **items;
+    long len;
+    Array *temp;
+    Status status;
+
+    LOCK(queue);
+    status = generate_array(queue, &items, &len);
+    UNLOCK(queue);
+    if (status != OK)
+        return status;
+
+    /* Allocate memory for the array struct */
+    if ((temp = (Array *)malloc(sizeof(Array))) == NULL) {
+        free(items);
+        return ALLOC_FAILURE;
+    }
+    temp->items = items;
+    temp->len = len;
+    *array = temp;
+
+    return OK;
+}
+
+Status ts_queue_iterator(ConcurrentQueue *queue, ConcurrentIterator **iter) {
+
+    void **items;
+    long len;
+    Status status;
+
+    /* Creates the array of items and locks the overflow queue */
+    LOCK(queue);
+    if ((status = generate_array(queue, &items, &len)) != OK) {
+        UNLOCK(queue);
+        return status;
+    }
+
+    /* Creates the iterator */
+    status = ts_iterator_new(iter, &(queue->lock), items, len);
+    if (status != OK) {
+        free(items);
+        UNLOCK(queue);
+    }
+
+    return status;
+}
+
+void ts_queue_destroy(ConcurrentQueue *queue, void (*destructor)(void *)) {
+
+    ts_queue_clear(queue, destructor);
+    queue_destroy(queue->overflow, destructor);
+    pthread_mutex_destroy(&(queue->lock));
+    free(queue->cells);
+    free(queue);
+}
@@ -0,0 +1,324 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uring.h"
+
+/* io_uring may be missing from older kernel headers, in which case every ring fails to set up */
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Ordered accesses to the indices shared with the kernel */
+#define LOAD_ACQUIRE(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*
+ * The struct for the io_uring ADT.
+ */
+struct uring {
+    int fd;                         /* The ring's descriptor */
+    unsigned entries;               /* Number of submission queue entries */
+    unsigned *sqHead;               /* Submission queue head, advanced by the kernel */
+    unsigned *sqTail;               /* Submission queue tail, advanced by us */
+    unsigned sqMask;                /* Mask applied to the submission queue indices */
+    unsigned sqeTail;               /* Tail of the entries prepared but not yet submitted */
+    struct io_uring_sqe *sqes;      /* The submission queue entries */
+    unsigned *cqHead;               /* Completion queue head, advanced by us */
+    unsigned *cqTail;               /* Completion queue tail, advanced by the kernel */
+    unsigned cqMask;                /* Mask applied to the completion queue indices */
+    struct io_uring_cqe *cqes;      /* The completion queue entries */
+    void *sqRing;                   /* Mapping holding the submission queue */
+    void *cqRing;                   /* Mapping holding the completion queue */
+    size_t sqRingSize;              /* Size of the submission queue mapping */
+    size_t cqRingSize;              /* Size of the completion queue mapping */
+    size_t sqesSize;                /* Size of the submission queue entries mapping */
+};
+
+Uring *uring_new(unsigned entries) {
+
+    struct io_uring_params params;
+    Uring *ring;
+    unsigned *array, i;
+    int err;
+
+    if ((ring = (Uring *)malloc(sizeof(Uring))) == NULL)
+        return NULL;
+
+    memset(&params, 0, sizeof(params));
+    if ((ring->fd = (int)syscall(SYS_io_uring_setup, entries, &params)) < 0) {
+        err = errno;
+        free(ring);
+        errno = err;
+        return NULL;
+    }
+
+    /* Maps the submission and completion queues, which may share a single mapping */
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize)
+            ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+        goto error;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    } else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            munmap(ring->sqRing, ring->sqRingSize);
+            goto error;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqesSize, PROT_READ|PROT_WRITE,
+                                             MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cqRing != ring->sqRing)
+            munmap(ring->cqRing, ring->cqRingSize);
+        munmap(ring->sqRing, ring->sqRingSize);
+        goto error;
+    }
+
+    /* Initialize the remaining struct members */
+    ring->entries = params.sq_entries;
+    ring->sqHead = (unsigned *)((char *)ring->sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned *)((char *)ring->sqRing + params.sq_off.tail);
+    ring->sqMask = *(unsigned *)((char *)ring->sqRing + params.sq_off.ring_mask);
+    ring->sqeTail = *(ring->sqTail);
+    ring->cqHead = (unsigned *)((char *)ring->cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned *)((char *)ring->cqRing + params.cq_off.tail);
+    ring->cqMask = *(unsigned *)((char *)ring->cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cqRing + params.cq_off.cqes);
+
+    /* Entries are always submitted in order, so the index array maps each slot to itself */
+    array = (unsigned *)((char *)ring->sqRing + params.sq_off.array);
+    for (i = 0; i < params.sq_entries; i++)
+        array[i] = i;
+
+    return ring;
+
+/*
+ * If anything goes wrong while mapping the rings, jump here to
+ * close the ring and free the struct
+ */
+error:
+    err = errno;
+    close(ring->fd);
+    free(ring);
+    errno = err;
+    return NULL;
+}
+
+/*
+ * Returns the next free submission queue entry, cleared, or NULL if the ring is full.
+ */
+static struct io_uring_sqe *next_sqe(Uring *ring) {
+
+    struct io_uring_sqe *sqe;
+
+    if (ring->sqeTail - LOAD_ACQUIRE(ring->sqHead) >= ring->entries)
+        return NULL;
+    sqe = &(ring->sqes[ring->sqeTail & ring->sqMask]);
+    ring->sqeTail++;
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+int uring_prep_openat(Uring *ring, int dfd, const char *path, int flags, void *data) {
+
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = next_sqe(ring)) == NULL)
+        return 1;
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dfd;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->open_flags = (uint32_t)flags;
+    sqe->user_data = (uint64_t)(uintptr_t)data;
+
+    return 0;
+}
+
+int uring_prep_statx(Uring *ring, int dfd, const char *path, int flags, unsigned mask,
+                     struct statx *buf, void *data) {
+
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = next_sqe(ring)) == NULL)
+        return 1;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dfd;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->len = mask;
+    sqe->off = (uint64_t)(uintptr_t)buf;
+    sqe->statx_flags = (uint32_t)flags;
+    sqe->user_data = (uint64_t)(uintptr_t)data;
+
+    return 0;
+}
+
+int uring_submit(Uring *ring, unsigned wait) {
+
+    unsigned submit;
+    int ret;
+
+    /* Publishes the prepared entries to the kernel */
+    STORE_RELEASE(ring->sqTail, ring->sqeTail);
+
+    for (;;) {
+        /*
+         * Entries the kernel has not consumed yet are counted from its head rather than
+         * from our tail, so the ones left behind by an earlier call are submitted again
+         */
+        submit = ring->sqeTail - LOAD_ACQUIRE(ring->sqHead);
+        if (submit == 0 && wait == 0)
+            return 0;
+        ret = (int)syscall(SYS_io_uring_enter, ring->fd, submit, wait,
+                           (wait > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0 || errno != EINTR)
+            break;
+    }
+
+    if (ret < 0)
+        return errno;
+    /* The kernel does not wait when it takes fewer entries than submitted */
+    return ((unsigned)ret < submit) ? EAGAIN : 0;
+}
+
+int uring_complete(Uring *ring, void **data, int *res) {
+
+    unsigned head = *(ring->cqHead);
+    struct io_uring_cqe *cqe;
+
+    if (head == LOAD_ACQUIRE(ring->cqTail))
+        return 1;
+    cqe = &(ring->cqes[head & ring->cqMask]);
+    *data = (void *)(uintptr_t)cqe->user_data;
+    *res = cqe->res;
+    STORE_RELEASE(ring->cqHead, head + 1);
+
+    return 0;
+}
+
+int uring_reclaim(Uring *ring, void **data) {
+
+    if (ring->sqeTail == LOAD_ACQUIRE(ring->sqHead))
+        return 1;
+    ring->sqeTail--;
+    *data = (void *)(uintptr_t)ring->sqes[ring->sqeTail & ring->sqMask].user_data;
+    /* Unpublishes it, in case it was published by a submission the kernel refused */
+    STORE_RELEASE(ring->sqTail, ring->sqeTail);
+
+    return 0;
+}
+
+void uring_destroy(Uring *ring) {
+
+    if (ring != NULL) {
+        /*
+         * Each entry the kernel has taken posts exactly one completion, so it still has
+         * operations writing into caller buffers until the two counts meet. Closing the
+         * ring does not wait for them, so they are waited out and discarded here.
+         */
+        while (LOAD_ACQUIRE(ring->sqHead) != LOAD_ACQUIRE(ring->cqTail)) {
+            STORE_RELEASE(ring->cqHead, *(ring->cqTail));
+            if (syscall(SYS_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+                    && errno != EINTR)
+                break;
+        }
+        munmap(ring->sqes, ring->sqesSize);
+        if (ring->cqRing != ring->sqRing)
+            munmap(ring->cqRing, ring->cqRingSize);
+        munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->fd);
+        free(ring);
+    }
+}
+
+#else   /* HAVE_IO_URING */
+
+/*
+ * Built without io_uring support; every ring fails to set up so callers fall back
+ * to synchronous system calls.
+ */
+struct uring {
+    int fd;
+};
+
+Uring *uring_new(unsigned entries) {
+    (void)entries;
+    errno = ENOSYS;
+    return NULL;
+}
+
+int uring_prep_openat(Uring *ring, int dfd, const char *path, int flags, void *data) {
+    (void)ring; (void)dfd; (void)path; (void)flags; (void)data;
+    return 1;
+}
+
+int uring_prep_statx(Uring *ring, int dfd, const char *path, int flags, unsigned mask,
+                     struct statx *buf, void *data) {
+    (void)ring; (void)dfd; (void)path; (void)flags; (void)mask; (void)buf; (void)data;
+    return 1;
+}
+
+int uring_submit(Uring *ring, unsigned wait) {
+    (void)ring; (void)wait;
+    return ENOSYS;
+}
+
+int uring_complete(Uring *ring, void **data, int *res) {
+    (void)ring; (void)data; (void)res;
+    return 1;
+}
+
+int uring_reclaim(Uring *ring, void **data) {
+    (void)ring; (void)data;
+    return 1;
+}
+
+void uring_destroy(Uring *ring) {
+    (void)ring;
+}
+
+#endif  /* HAVE_IO_URING */
@@ -22,31 +22,128 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include "queue.h"
+#include <string.h>
+#include <unistd.h>
+#include "treeset.h"
+#include "ts_queue.h"
 #include "work_queue.h"
 
 /* Default number of threads to assign */
 #define DEFAULT_THREADS 1
 
+/* Number of items the inner queue holds without locking before it overflows */
+#define RING_CAPACITY 4096L
+
+/* Size of the buffers spilled records are written out from and read back into */
+#define SPILL_BUFFER (64 * 1024)
+
+/* Number of times a thread out of work looks for more without the lock before it sleeps */
+#define IDLE_SPINS 64
+
 /* Macros referring to the work queue's mutex and condition variables */
 /* Simply used for short-hand expressions and readability */
 #define MUTEX(q) (&(q->mutex))
 #define COND(q)  (&(q->condition))
 
+/*
+ * A lane of items sharing the same key, with a limit on how many of them may be worked
+ * on at once.
+ */
+typedef struct {
+    uint64_t key;               /* The key shared by the lane's items */
+    Queue *items;               /* The items waiting in the lane */
+    int inflight;               /* Number of the lane's items being worked on */
+    int limit;                  /* Max number of items worked on at once, 0 if unlimited */
+} Lane;
+
+/*
+ * An item with a cost, queued ahead of the others.
+ */
+typedef struct {
+    long cost;                  /* The item's cost */
+    void *item;                 /* The item */
+} Urgent;
+
 /* The work queue struct */
 struct work_queue {
     pthread_mutex_t mutex;      /* The mutex used for locking */
     pthread_cond_t condition;   /* The condition variable for waiting */
-    Queue *workQueue;           /* The inner queue to hold the work */
-    int active;                 /* The number of active threads working on this queue */
+    ConcurrentQueue *workQueue; /* The inner queue to hold the work, used without the lock if possible */
+    Queue **shards;             /* Queues of the work added by each group of threads */
+    int nShards;                /* Number of shards, 0 if there are none */
+    atomic_long queued;         /* Number of items held in memory, in the queue and lanes */
+    WorkQueueKey key;           /* Gives the lane of an item, NULL if there are no lanes */
+    WorkQueueLimit limit;       /* Gives the limit of a new lane */
+    void *limitArg;             /* Argument passed to the limit function */
+    Lane *lanes;                /* The lanes */
+    int nLanes;                 /* Number of lanes */
+    int nextLane;               /* The lane to look in first for the next item */
+    WorkQueueCost cost;         /* Gives the cost of an item, NULL if there are no priorities */
+    TreeSet *urgent;            /* The items with a cost, costliest first */
+    atomic_long nUrgent;        /* Number of items with a cost queued */
+    atomic_int active;          /* The number of active threads working on this queue */
+    atomic_int threads;         /* The number of threads expected to access this queue */
+    atomic_int allowed;         /* Max number of threads working at once, 0 if all of them */
+    atomic_int waiting;         /* The number of threads waiting for an item */
+    atomic_int spinning;        /* The number of threads looking for an item without the lock */
+    int spillFd;                /* Descriptor of the spill file, -1 if not spilling */
+    long spillLimit;            /* Number of items held in memory before spilling */
+    WorkQueueWriter writer;     /* Writes items out to records */
+    WorkQueueReader reader;     /* Recreates items from records */
+    void (*destructor)(void *); /* Releases items read back that cannot be queued */
+    char *writeBuffer;          /* Records not yet written to the spill file */
+    size_t writeLen;            /* Number of bytes in the write buffer */
+    char *readBuffer;           /* Records read back from the spill file */
+    off_t readOffset;           /* Offset of the next record to read back */
+    off_t writeOffset;          /* Offset the write buffer will be written at */
+    long spilled;               /* Number of records waiting in the file and write buffer */
+    long spilledTotal;          /* Number of items spilled so far */
 };
 
+/*
+ * Returns the number of items held in memory.
+ */
+static long queued(WorkQueue *queue) {
+    return atomic_load_explicit(&(queue->queued), memory_order_relaxed);
+}
+
+/*
+ * Counts 'n' more items held in memory ('n' may be negative).
+ */
+static void count_queued(WorkQueue *queue, long n) {
+    atomic_fetch_add_explicit(&(queue->queued), n, memory_order_relaxed);
+}
+
+/*
+ * Returns 1 if the items added to, or taken from, the shard 'shard' go through the inner
+ * queue without the lock: there are no lanes, no such shard, and no spill file. All of
+ * these are set up before any thread starts on the queue.
+ */
+static int lock_free(WorkQueue *queue, int shard) {
+    return queue->key == NULL && queue->spillFd < 0 && (shard < 0 || shard >= queue->nShards);
+}
+
+/*
+ * Returns the cost of the item 'item', or 0 if it is to be queued as usual: the queue
+ * has no priorities, or the item goes into a lane.
+ */
+static long item_cost(WorkQueue *queue, void *item) {
+    return (queue->cost != NULL && queue->key == NULL) ? queue->cost(item) : 0L;
+}
+
 int work_queue_new(WorkQueue **queue, int threads) {
 
     WorkQueue *temp = NULL;
-    Queue *workQueue = NULL;
+    ConcurrentQueue *workQueue = NULL;
     int status = 0;
 
     /* Allocates the work queue structure */
@@ -55,7 +152,7 @@ int work_queue_new(WorkQueue **queue, int threads) {
         goto error;
     }
     /* Allocates the inner work queue structure */
-    if (queue_new(&workQueue) != OK) {
+    if (ts_queue_new(&workQueue, RING_CAPACITY) != OK) {
         status = 1;
         goto error;
     }
@@ -70,7 +167,27 @@ int work_queue_new(WorkQueue **queue, int threads) {
 
     /* Set up reminaing structure members */
     temp->workQueue = workQueue;
-    temp->active = ((threads <= 0) ? threads : DEFAULT_THREADS);
+    atomic_init(&(temp->active), ((threads > 0) ? threads : DEFAULT_THREADS));
+    atomic_init(&(temp->threads), ((threads > 0) ? threads : DEFAULT_THREADS));
+    atomic_init(&(temp->allowed), 0);
+    atomic_init(&(temp->waiting), 0);
+    atomic_init(&(temp->spinning), 0);
+    atomic_init(&(temp->queued), 0L);
+    temp->shards = NULL;
+    temp->nShards = 0;
+    temp->key = NULL;
+    temp->lanes = NULL;
+    temp->nLanes = 0;
+    temp->nextLane = 0;
+    temp->cost = NULL;
+    temp->urgent = NULL;
+    atomic_init(&(temp->nUrgent), 0L);
+    temp->spillFd = -1;
+    temp->spillLimit = 0L;
+    temp->writeBuffer = NULL;
+    temp->readBuffer = NULL;
+    temp->spilled = 0L;
+    temp->spilledTotal = 0L;
     *queue = temp;
 
     return status;
@@ -83,61 +200,920 @@ error:
     if (temp != NULL)
         free(temp);
     if (workQueue != NULL)
-        queue_destroy(workQueue, NULL);
+        ts_queue_destroy(workQueue, NULL);
+    return status;
+}
+
+/*
+ * Returns the lane for the key 'key', creating it if it's new, or NULL if it could not
+ * be created. Must hold the lock.
+ */
+static Lane *find_lane(WorkQueue *queue, uint64_t key) {
+
+    Lane *lanes, *lane;
+    int i;
+
+    for (i = 0; i < queue->nLanes; i++) {
+        if (queue->lanes[i].key == key)
+            return &(queue->lanes[i]);
+    }
+
+    if ((lanes = (Lane *)realloc(queue->lanes, (queue->nLanes + 1) * sizeof(Lane))) == NULL)
+        return NULL;
+    queue->lanes = lanes;
+    lane = &(lanes[queue->nLanes]);
+    if (queue_new(&(lane->items)) != OK)
+        return NULL;
+    lane->key = key;
+    lane->inflight = 0;
+    lane->limit = queue->limit(key, queue->limitArg);
+    if (lane->limit < 0)
+        lane->limit = 0;
+    queue->nLanes++;
+
+    return lane;
+}
+
+/*
+ * Returns the queue the item 'item' belongs in: its lane, or otherwise the shard 'shard'.
+ * Returns NULL if it belongs in the inner queue, as there is no such shard or its lane
+ * could not be created. Must hold the lock.
+ */
+static Queue *target_queue(WorkQueue *queue, int shard, void *item) {
+
+    Lane *lane;
+
+    if (queue->key != NULL && (lane = find_lane(queue, queue->key(item))) != NULL)
+        return lane->items;
+    if (shard >= 0 && shard < queue->nShards)
+        return queue->shards[shard];
+    return NULL;
+}
+
+/*
+ * Adds the item 'item' to the queue it belongs in. Must hold the lock.
+ */
+static Status enqueue(WorkQueue *queue, int shard, void *item) {
+
+    long cost = item_cost(queue, item);
+    Queue *target;
+    Urgent *urgent;
+    Status status;
+
+    /* Items with a cost are queued ahead of the others; if they can't be, they are queued as usual */
+    if (cost > 0L && (urgent = (Urgent *)malloc(sizeof(Urgent))) != NULL) {
+        urgent->cost = cost;
+        urgent->item = item;
+        if (treeset_add(queue->urgent, urgent) == OK) {
+            atomic_fetch_add_explicit(&(queue->nUrgent), 1L, memory_order_relaxed);
+            count_queued(queue, 1L);
+            return OK;
+        }
+        free(urgent);
+    }
+
+    target = target_queue(queue, shard, item);
+    status = (target != NULL) ? queue_add(target, item) : ts_queue_add(queue->workQueue, item);
+    if (status == OK)
+        count_queued(queue, 1L);
+
     return status;
 }
 
+/*
+ * Removes the costliest of the items with a cost into '*item'. Returns 0 if successful,
+ * 1 if there was none. Must hold the lock.
+ */
+static int dequeue_urgent(WorkQueue *queue, void **item) {
+
+    Urgent *urgent;
+
+    if (queue->urgent == NULL || treeset_pollFirst(queue->urgent, (void **)&urgent) != OK)
+        return 1;
+    *item = urgent->item;
+    free(urgent);
+    atomic_fetch_sub_explicit(&(queue->nUrgent), 1L, memory_order_relaxed);
+    count_queued(queue, -1L);
+
+    return 0;
+}
+
+/*
+ * Returns 1 if the item added next is to be spilled, so that once anything is spilled,
+ * the rest follows it and the order is kept. Must hold the lock.
+ */
+static int spilling(WorkQueue *queue) {
+    return queue->spillFd >= 0 && (queue->spilled > 0L || queued(queue) >= queue->spillLimit);
+}
+
+/*
+ * Returns 1 if the lane 'lane' has items waiting and is under its limit.
+ */
+static int lane_open(Lane *lane) {
+    return queue_isEmpty(lane->items) == FALSE && (lane->limit == 0 || lane->inflight < lane->limit);
+}
+
+/*
+ * Returns 1 if there is an item that can be taken right now. Must hold the lock.
+ */
+static int eligible(WorkQueue *queue) {
+
+    int i;
+
+    if (ts_queue_isEmpty(queue->workQueue) == FALSE ||
+        atomic_load_explicit(&(queue->nUrgent), memory_order_relaxed) > 0L)
+        return 1;
+    for (i = 0; i < queue->nShards; i++) {
+        if (queue_isEmpty(queue->shards[i]) == FALSE)
+            return 1;
+    }
+    for (i = 0; i < queue->nLanes; i++) {
+        if (lane_open(&(queue->lanes[i])))
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Removes the next item that can be taken right now into '*item'. The items with a cost
+ * are taken first, then the shard 'shard', then the inner queue, then the other shards.
+ * The lanes are taken from in turn, skipping those at their limit. Returns 0 if
+ * successful, 1 if there was none. Must hold the lock.
+ */
+static int dequeue(WorkQueue *queue, int shard, void **item) {
+
+    int i, n = queue->nLanes;
+
+    if (dequeue_urgent(queue, item) == 0)
+        return 0;
+    if (shard >= 0 && shard < queue->nShards && queue_poll(queue->shards[shard], item) == OK) {
+        count_queued(queue, -1L);
+        return 0;
+    }
+    if (ts_queue_poll(queue->workQueue, item) == OK) {
+        count_queued(queue, -1L);
+        return 0;
+    }
+    /* Work is only taken from the other shards once there is none closer */
+    for (i = 1; i <= queue->nShards; i++) {
+        if (queue_poll(queue->shards[(shard + i + queue->nShards) % queue->nShards], item) == OK) {
+            count_queued(queue, -1L);
+            return 0;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        Lane *lane = &(queue->lanes[(queue->nextLane + i) % n]);
+        if (lane_open(lane)) {
+            (void)queue_poll(lane->items, item);
+            lane->inflight++;
+            queue->nextLane = (queue->nextLane + i + 1) % n;
+            count_queued(queue, -1L);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Returns the most items a thread takes at once, given that it asked for 'max': no more
+ * than a fair share of the items in memory, so that each waiting thread is left some.
+ */
+static long fair_share(WorkQueue *queue, long max) {
+
+    long share = queued(queue) / (atomic_load_explicit(&(queue->waiting), memory_order_relaxed) +
+                                  atomic_load_explicit(&(queue->spinning), memory_order_relaxed) + 1L);
+
+    if (max > share)
+        max = (share > 0L) ? share : 1L;
+    return max;
+}
+
+/*
+ * Moves up to 'max' items from the front of the inner queue onto the end of 'items'.
+ * Returns the number of items moved; the caller counts them out.
+ */
+static long poll_inner(WorkQueue *queue, Queue *items, long max) {
+
+    long n;
+    void *item;
+
+    for (n = 0L; n < max && ts_queue_poll(queue->workQueue, &item) == OK; n++) {
+        if (queue_add(items, item) != OK) {
+            /* It goes back, if at the end; it was never counted out */
+            (void)ts_queue_add(queue->workQueue, item);
+            break;
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Moves up to 'max' items that can be taken right now onto the end of 'items', all from
+ * the same place, looked in in the same order as 'dequeue()'. Only a fair share is
+ * taken, and lanes give one item at a time. Returns the number of items taken. Must
+ * hold the lock.
+ */
+static long dequeue_all(WorkQueue *queue, int shard, Queue *items, long max) {
+
+    long n = 0L;
+    int i;
+    void *item;
+
+    /* The costliest item is taken by itself, so the next goes to another thread */
+    if (dequeue_urgent(queue, &item) == 0) {
+        if (queue_add(items, item) == OK)
+            return 1L;
+        (void)enqueue(queue, shard, item);
+    }
+    max = fair_share(queue, max);
+    if (shard >= 0 && shard < queue->nShards)
+        n = queue_splice(items, queue->shards[shard], max);
+    if (n == 0L)
+        n = poll_inner(queue, items, max);
+    for (i = 1; n == 0L && i <= queue->nShards; i++)
+        n = queue_splice(items, queue->shards[(shard + i + queue->nShards) % queue->nShards], max);
+    for (i = 0; n == 0L && i < queue->nLanes; i++) {
+        Lane *lane = &(queue->lanes[(queue->nextLane + i) % queue->nLanes]);
+        if (lane_open(lane)) {
+            n = queue_splice(items, lane->items, 1L);
+            lane->inflight++;
+            queue->nextLane = (queue->nextLane + i + 1) % queue->nLanes;
+        }
+    }
+    count_queued(queue, -n);
+
+    return n;
+}
+
+/*
+ * Wakes one of the waiting threads if there is an item it can take. Rather than waking
+ * all of them for every change, each thread woken up wakes the next if there is still
+ * more to take. Must hold the lock.
+ */
+static void wake_one(WorkQueue *queue) {
+
+    if (atomic_load_explicit(&(queue->waiting), memory_order_relaxed) > 0 && eligible(queue))
+        (void)pthread_cond_signal(COND(queue));
+}
+
+/*
+ * Recreates the items of the 'len' bytes of records in 'buffer' and adds them to the
+ * in-memory queue. Returns the number of bytes of whole records consumed.
+ */
+static size_t load_records(WorkQueue *queue, const char *buffer, size_t len) {
+
+    size_t pos = 0;
+    uint32_t recLen;
+    void *item;
+
+    while (pos + sizeof(recLen) <= len) {
+        memcpy(&recLen, buffer + pos, sizeof(recLen));
+        if (pos + sizeof(recLen) + recLen > len)
+            break;
+        if ((item = queue->reader(buffer + pos + sizeof(recLen), recLen)) != NULL) {
+            if (enqueue(queue, -1, item) != OK)
+                queue->destructor(item);
+        }
+        pos += sizeof(recLen) + recLen;
+        queue->spilled--;
+    }
+
+    return pos;
+}
+
+/*
+ * Writes the write buffer out to the end of the spill file. If the write fails, the
+ * buffered records are brought back into memory instead. Must hold the lock.
+ */
+static void flush_records(WorkQueue *queue) {
+
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < queue->writeLen) {
+        n = pwrite(queue->spillFd, queue->writeBuffer + done, queue->writeLen - done,
+                   queue->writeOffset + (off_t)done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    queue->writeOffset += (off_t)done;
+    /* Whatever was not written is loaded straight back */
+    if (done < queue->writeLen)
+        (void)load_records(queue, queue->writeBuffer + done, queue->writeLen - done);
+    queue->writeLen = 0;
+}
+
+/*
+ * Writes the item 'item' out to the spill file. Returns 0 if spilled, 1 if the item
+ * has to be kept in memory instead. Must hold the lock.
+ */
+static int spill_item(WorkQueue *queue, void *item) {
+
+    uint32_t recLen;
+    size_t len;
+
+    if (queue->writeLen + sizeof(recLen) + WORK_QUEUE_RECORD_MAX > SPILL_BUFFER)
+        flush_records(queue);
+    len = queue->writer(item, queue->writeBuffer + queue->writeLen + sizeof(recLen), WORK_QUEUE_RECORD_MAX);
+    if (len == 0)
+        return 1;
+
+    recLen = (uint32_t)len;
+    memcpy(queue->writeBuffer + queue->writeLen, &recLen, sizeof(recLen));
+    queue->writeLen += sizeof(recLen) + len;
+    queue->spilled++;
+    queue->spilledTotal++;
+    return 0;
+}
+
+/*
+ * Reads the next batch of spilled items back into memory, if none of the items in
+ * memory can be taken. Once every record has been read back, the file is emptied.
+ * Must hold the lock.
+ */
+static void refill(WorkQueue *queue) {
+
+    size_t used;
+    ssize_t n;
+
+    while (queue->spilled > 0L && !eligible(queue) && queued(queue) < queue->spillLimit) {
+
+        if (queue->readOffset == queue->writeOffset) {
+            /* All that is left is in the write buffer */
+            (void)load_records(queue, queue->writeBuffer, queue->writeLen);
+            queue->writeLen = 0;
+        } else {
+            do {
+                n = pread(queue->spillFd, queue->readBuffer, SPILL_BUFFER, queue->readOffset);
+            } while (n < 0 && errno == EINTR);
+            used = (n > 0) ? load_records(queue, queue->readBuffer, (size_t)n) : 0;
+            if (used == 0) {
+                /* The file cannot be read back, the records left in it are lost */
+                queue->readOffset = queue->writeOffset;
+                (void)load_records(queue, queue->writeBuffer, queue->writeLen);
+                queue->writeLen = 0;
+                queue->spilled = 0L;
+            }
+            queue->readOffset += (off_t)used;
+        }
+
+        if (queue->readOffset == queue->writeOffset && queue->writeLen == 0) {
+            /* Starts the file over, so it never grows past what is spilled at once */
+            queue->spilled = 0L;
+            queue->readOffset = queue->writeOffset = 0;
+            (void)ftruncate(queue->spillFd, 0);
+        }
+    }
+}
+
+/*
+ * Moves the items in 'items' to the end of the inner queue, for as long as it can grow,
+ * up to the first item with a cost. Returns the number of items moved; the caller counts
+ * them in.
+ */
+static long add_inner(WorkQueue *queue, Queue *items) {
+
+    long n = 0L;
+    void *item;
+
+    while (queue_peek(items, &item) == OK && item_cost(queue, item) == 0L &&
+           ts_queue_add(queue->workQueue, item) == OK) {
+        (void)queue_poll(items, &item);
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * Wakes up to 'n' waiting threads for the 'n' items just added to the inner queue
+ * without the lock. The fence pairs with the one in 'wait_for_work()': either this
+ * thread sees the other waiting, or the other sees the new items before it waits.
+ */
+static void wake_added(WorkQueue *queue, long n) {
+
+    long waiting;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&(queue->waiting), memory_order_relaxed) == 0)
+        return;
+    (void)pthread_mutex_lock(MUTEX(queue));
+    for (waiting = atomic_load_explicit(&(queue->waiting), memory_order_relaxed); n > 0L && waiting > 0L; n--, waiting--)
+        (void)pthread_cond_signal(COND(queue));
+    (void)pthread_mutex_unlock(MUTEX(queue));
+}
+
+int work_queue_addAll(WorkQueue *queue, int shard, Queue *items) {
+
+    long n = queue_size(items), moved, waiting;
+    Queue *target;
+    void *item;
+
+    if (lock_free(queue, shard)) {
+        moved = add_inner(queue, items);
+        count_queued(queue, moved);
+        wake_added(queue, moved);
+        /* Items with a cost are left over, they are queued under the lock */
+        if (queue->cost == NULL || queue_isEmpty(items) == TRUE)
+            return queue_isEmpty(items) == FALSE;
+        n -= moved;
+    }
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    if (queue->key == NULL && queue->cost == NULL && !spilling(queue)) {
+        /* All of them go to the same place, in one move */
+        target = target_queue(queue, shard, NULL);
+        count_queued(queue, (target != NULL) ? queue_splice(target, items, -1L) : add_inner(queue, items));
+    } else {
+        /* Otherwise each is moved over by itself, still without allocating */
+        while (queue_peek(items, &item) == OK) {
+            if (item_cost(queue, item) > 0L && enqueue(queue, shard, item) == OK) {
+                (void)queue_poll(items, &item);
+                continue;
+            }
+            if (spilling(queue) && spill_item(queue, item) == 0) {
+                (void)queue_poll(items, &item);
+                continue;
+            }
+            if ((target = target_queue(queue, shard, item)) != NULL)
+                count_queued(queue, queue_splice(target, items, 1L));
+            else if (ts_queue_add(queue->workQueue, item) == OK) {
+                (void)queue_poll(items, &item);
+                count_queued(queue, 1L);
+            } else
+                break;
+        }
+    }
+    /* Wakes as many threads as there are new items, no more */
+    for (waiting = atomic_load_explicit(&(queue->waiting), memory_order_relaxed); n > 0L && waiting > 0L; n--, waiting--)
+        (void)pthread_cond_signal(COND(queue));
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return queue_isEmpty(items) == FALSE;
+}
+
 int work_queue_add(WorkQueue *queue, void *item) {
+    return work_queue_addTo(queue, -1, item);
+}
+
+int work_queue_addTo(WorkQueue *queue, int shard, void *item) {
 
     int status = 0;
 
+    if (lock_free(queue, shard) && item_cost(queue, item) == 0L) {
+        if (ts_queue_add(queue->workQueue, item) != OK)
+            return 1;
+        count_queued(queue, 1L);
+        wake_added(queue, 1L);
+        return 0;
+    }
+
     /* Locks and adds the item */
     (void)pthread_mutex_lock(MUTEX(queue));
-    if (queue_add(queue->workQueue, item) != OK) {
+    if (item_cost(queue, item) == 0L && spilling(queue) && spill_item(queue, item) == 0) {
+        status = 0;
+    } else if (enqueue(queue, shard, item) != OK) {
         status = 1;
     }
-    /* Unlocks and broadcasts the change in condition */
-    (void)pthread_cond_broadcast(COND(queue));
+    /* One item only needs one thread to wake up for it */
+    if (atomic_load_explicit(&(queue->waiting), memory_order_relaxed) > 0)
+        (void)pthread_cond_signal(COND(queue));
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return status;
+}
+
+/*
+ * Has the calling thread wait until there is an item it can take, or until no thread is
+ * working. The caller has already stopped counting as working.
+ * If there is nothing to take but other threads are still working, we must assume the
+ * possibility of other work arriving (or of a lane freeing up); thread will wait on this
+ * condition. Must hold the lock.
+ */
+static void wait_for_work(WorkQueue *queue) {
+
+    int allowed, active;
+
+    atomic_fetch_add_explicit(&(queue->waiting), 1, memory_order_relaxed);
+    /* Pairs with the fence in 'wake_added()' */
+    atomic_thread_fence(memory_order_seq_cst);
+    for (;;) {
+        refill(queue);
+        allowed = atomic_load_explicit(&(queue->allowed), memory_order_relaxed);
+        active = atomic_load(&(queue->active));
+        if (active == 0 || (eligible(queue) && (allowed == 0 || active < allowed)))
+            break;
+        pthread_cond_wait(COND(queue), MUTEX(queue));
+    }
+    atomic_fetch_sub_explicit(&(queue->waiting), 1, memory_order_relaxed);
+}
+
+/*
+ * Wakes the threads waiting once a thread is done polling. Once no thread is working, all
+ * of them are woken to finish. Otherwise only one is, and only if there's more to take;
+ * it wakes the next in turn. Must hold the lock.
+ */
+static void leave_poll(WorkQueue *queue) {
+
+    if (atomic_load(&(queue->active)) == 0)
+        (void)pthread_cond_broadcast(COND(queue));
+    else
+        wake_one(queue);
+}
+
+/*
+ * Returns 1 if a thread polling from the shard 'shard' may first try the inner queue
+ * without the lock. It's still working until it waits, so it need not be counted out;
+ * but once the queue is throttled, it must stop by the lock to be held back. Items
+ * with a cost are taken under the lock, ahead of the inner queue.
+ */
+static int poll_fast(WorkQueue *queue, int shard) {
+    return lock_free(queue, shard) && atomic_load_explicit(&(queue->allowed), memory_order_relaxed) == 0 &&
+           atomic_load_explicit(&(queue->nUrgent), memory_order_relaxed) == 0L;
+}
+
+/*
+ * Returns 1 if no thread is working and there is nothing left to take, after waking the
+ * threads waiting so they finish. Threads stop working without the lock only once they
+ * have seen the inner queue empty, and those stopping under the lock look for items only
+ * after; seeing nothing to take and then no thread working, under the lock, covers both.
+ */
+static int quiesced(WorkQueue *queue) {
+
+    int done;
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    refill(queue);
+    done = !eligible(queue) && atomic_load(&(queue->active)) == 0;
+    if (done)
+        (void)pthread_cond_broadcast(COND(queue));
     (void)pthread_mutex_unlock(MUTEX(queue));
 
+    return done;
+}
+
+/*
+ * Has a thread that stopped working, having seen the inner queue empty, keep looking for
+ * items there without the lock for a while. Returns 0 once there are some, the thread
+ * working again to take them; 1 if the queue has quiesced; or -1 if the thread must wait
+ * under the lock instead.
+ */
+static int spin_for_work(WorkQueue *queue, int shard) {
+
+    int i, status = -1;
+
+    atomic_fetch_add_explicit(&(queue->spinning), 1, memory_order_relaxed);
+    for (i = 0; i < IDLE_SPINS && poll_fast(queue, shard); i++) {
+        if (ts_queue_isEmpty(queue->workQueue) == FALSE) {
+            atomic_fetch_add(&(queue->active), 1);
+            status = 0;
+            break;
+        }
+        /* Only worth the lock once no thread is left working */
+        if (atomic_load(&(queue->active)) == 0 && quiesced(queue)) {
+            status = 1;
+            break;
+        }
+        (void)sched_yield();
+    }
+    atomic_fetch_sub_explicit(&(queue->spinning), 1, memory_order_relaxed);
+
     return status;
 }
 
 int work_queue_poll(WorkQueue *queue, void **item) {
+    return work_queue_pollFrom(queue, -1, item);
+}
 
-    int status = 1;
+int work_queue_pollFrom(WorkQueue *queue, int shard, void **item) {
+
+    int status = 1, spin = 0;
+
+    if (poll_fast(queue, shard)) {
+        /* Once the inner queue is seen empty, the thread stops working without the lock */
+        while (ts_queue_poll(queue->workQueue, item) != OK) {
+            atomic_fetch_sub(&(queue->active), 1);
+            if ((spin = spin_for_work(queue, shard)) != 0)
+                break;
+        }
+        if (spin == 0) {
+            count_queued(queue, -1L);
+            return 0;
+        }
+        if (spin == 1)
+            return 1;
+    }
 
-    /*
-     * Locks and waits on the condition if needed.
-     * If the queue is empty but other threads are still working, we must assume
-     * the possibility of other work arriving; thread will wait on this condition.
-     */
     (void)pthread_mutex_lock(MUTEX(queue));
-    queue->active--;
-    while (queue->active > 0 && queue_isEmpty(queue->workQueue) == TRUE) {
-        pthread_cond_wait(COND(queue), MUTEX(queue));
+    if (spin == 0)
+        atomic_fetch_sub(&(queue->active), 1);
+    for (;;) {
+        wait_for_work(queue);
+        /* Fetch the next item from queue (if exists) */
+        if (dequeue(queue, shard, item) == 0) {
+            atomic_fetch_add(&(queue->active), 1);
+            status = 0;
+            break;
+        }
+        /* Another thread may have taken it without the lock first */
+        if (atomic_load(&(queue->active)) == 0)
+            break;
+    }
+    leave_poll(queue);
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return status;
+}
+
+int work_queue_pollAll(WorkQueue *queue, int shard, Queue *items, long max) {
+
+    int status = 1, spin = 0;
+    long n;
+
+    if (max <= 0L)
+        max = 1L;
+    if (poll_fast(queue, shard)) {
+        while ((n = poll_inner(queue, items, fair_share(queue, max))) == 0L) {
+            atomic_fetch_sub(&(queue->active), 1);
+            if ((spin = spin_for_work(queue, shard)) != 0)
+                break;
+        }
+        if (spin == 0) {
+            count_queued(queue, -n);
+            return 0;
+        }
+        if (spin == 1)
+            return 1;
+    }
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    if (spin == 0)
+        atomic_fetch_sub(&(queue->active), 1);
+    for (;;) {
+        wait_for_work(queue);
+        if (dequeue_all(queue, shard, items, max) > 0L) {
+            atomic_fetch_add(&(queue->active), 1);
+            status = 0;
+            break;
+        }
+        if (atomic_load(&(queue->active)) == 0)
+            break;
+    }
+    leave_poll(queue);
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return status;
+}
+
+int work_queue_tryPoll(WorkQueue *queue, void **item) {
+    return work_queue_tryPollFrom(queue, -1, item);
+}
+
+int work_queue_tryPollFrom(WorkQueue *queue, int shard, void **item) {
+
+    int status = 1;
+
+    if (lock_free(queue, shard) && atomic_load_explicit(&(queue->nUrgent), memory_order_relaxed) == 0L) {
+        if (ts_queue_poll(queue->workQueue, item) != OK)
+            return 1;
+        count_queued(queue, -1L);
+        return 0;
     }
 
-    /* Fetch the next item from queue (if exists) */
-    if (queue_size(queue->workQueue) > 0L) {
-        (void)queue_poll(queue->workQueue, item);
-        queue->active++;
+    /* The calling thread stays active, so there is no need to wait */
+    (void)pthread_mutex_lock(MUTEX(queue));
+    refill(queue);
+    if (dequeue(queue, shard, item) == 0)
         status = 0;
+    /* Items read back from the spill file may be left for the waiting threads */
+    wake_one(queue);
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return status;
+}
+
+int work_queue_spill(WorkQueue *queue, long limit, const char *dir, WorkQueueWriter writer,
+                     WorkQueueReader reader, void (*destructor)(void *)) {
+
+    char path[4096];
+    int fd;
+
+    if ((size_t)snprintf(path, sizeof(path), "%s/cfc-spill-XXXXXX", dir) >= sizeof(path))
+        return ENAMETOOLONG;
+    if ((fd = mkostemp(path, O_CLOEXEC)) < 0)
+        return errno;
+    /* The file is only ever used through its descriptor, and goes away with it */
+    (void)unlink(path);
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    if ((queue->writeBuffer = (char *)malloc(SPILL_BUFFER)) == NULL ||
+        (queue->readBuffer = (char *)malloc(SPILL_BUFFER)) == NULL) {
+        free(queue->writeBuffer);
+        queue->writeBuffer = NULL;
+        (void)pthread_mutex_unlock(MUTEX(queue));
+        close(fd);
+        return ENOMEM;
     }
-    /* Unlock and broadcast the change in condition */
+    queue->spillFd = fd;
+    queue->spillLimit = (limit > 0L) ? limit : 1L;
+    queue->writer = writer;
+    queue->reader = reader;
+    queue->destructor = destructor;
+    queue->writeLen = 0;
+    queue->readOffset = queue->writeOffset = 0;
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return 0;
+}
+
+void work_queue_throttle(WorkQueue *queue, int threads) {
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    atomic_store_explicit(&(queue->allowed), (threads > 0) ? threads : 0, memory_order_relaxed);
+    /* Threads held back may now be let through */
     (void)pthread_cond_broadcast(COND(queue));
     (void)pthread_mutex_unlock(MUTEX(queue));
+}
 
-    return status;
+int work_queue_shards(WorkQueue *queue, int shards) {
+
+    Queue **temp;
+    int i;
+
+    if ((temp = (Queue **)calloc((size_t)shards, sizeof(Queue *))) == NULL)
+        return 1;
+    for (i = 0; i < shards; i++) {
+        if (queue_new(&(temp[i])) != OK) {
+            while (--i >= 0)
+                queue_destroy(temp[i], NULL);
+            free(temp);
+            return 1;
+        }
+    }
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    queue->shards = temp;
+    queue->nShards = shards;
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return 0;
+}
+
+int work_queue_lanes(WorkQueue *queue, WorkQueueKey key, WorkQueueLimit limit, void *arg) {
+
+    Queue *items;
+    void *item;
+    long n;
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    queue->key = key;
+    queue->limit = limit;
+    queue->limitArg = arg;
+    /* Items already queued are moved into their lanes */
+    if (queue_new(&items) == OK) {
+        while (ts_queue_poll(queue->workQueue, &item) == OK)
+            (void)queue_add(items, item);
+        for (n = queue_size(items); n > 0L; n--) {
+            (void)queue_poll(items, &item);
+            count_queued(queue, -1L);
+            if (enqueue(queue, -1, item) != OK) {
+                (void)ts_queue_add(queue->workQueue, item);
+                count_queued(queue, 1L);
+            }
+        }
+        queue_destroy(items, NULL);
+    }
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return 0;
+}
+
+/*
+ * Compares the items with a cost 'a' and 'b', so that the costliest sorts first. Items
+ * of the same cost are told apart by their address.
+ */
+static int compare_urgent(void *a, void *b) {
+
+    Urgent *x = (Urgent *)a, *y = (Urgent *)b;
+
+    if (x->cost != y->cost)
+        return (x->cost < y->cost) ? 1 : -1;
+    return (x->item < y->item) ? -1 : ((x->item > y->item) ? 1 : 0);
+}
+
+int work_queue_priority(WorkQueue *queue, WorkQueueCost cost) {
+
+    TreeSet *urgent;
+
+    if (treeset_new(&urgent, compare_urgent) != OK)
+        return 1;
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    queue->urgent = urgent;
+    queue->cost = cost;
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return 0;
+}
+
+void work_queue_done(WorkQueue *queue, uint64_t key) {
+
+    int i;
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    for (i = 0; i < queue->nLanes; i++) {
+        Lane *lane = &(queue->lanes[i]);
+        if (lane->key == key) {
+            if (lane->inflight > 0)
+                lane->inflight--;
+            /* A thread may be waiting on the lane to free up */
+            if (queue_isEmpty(lane->items) == FALSE)
+                (void)pthread_cond_broadcast(COND(queue));
+            break;
+        }
+    }
+    (void)pthread_mutex_unlock(MUTEX(queue));
+}
+
+long work_queue_spilled(WorkQueue *queue) {
+
+    long spilled;
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    spilled = queue->spilledTotal;
+    (void)pthread_mutex_unlock(MUTEX(queue));
+
+    return spilled;
+}
+
+void work_queue_join(WorkQueue *queue) {
+
+    /* The new thread starts out working, as all threads do */
+    (void)pthread_mutex_lock(MUTEX(queue));
+    atomic_fetch_add(&(queue->active), 1);
+    atomic_fetch_add_explicit(&(queue->threads), 1, memory_order_relaxed);
+    (void)pthread_mutex_unlock(MUTEX(queue));
+}
+
+void work_queue_leave(WorkQueue *queue) {
+
+    (void)pthread_mutex_lock(MUTEX(queue));
+    atomic_fetch_sub(&(queue->active), 1);
+    atomic_fetch_sub_explicit(&(queue->threads), 1, memory_order_relaxed);
+    /* The leaving thread may have been the last one working, or held another back */
+    (void)pthread_cond_broadcast(COND(queue));
+    (void)pthread_mutex_unlock(MUTEX(queue));
+}
+
+int work_queue_waiting(WorkQueue *queue) {
+
+    int waiting = atomic_load_explicit(&(queue->waiting), memory_order_relaxed) +
+                  atomic_load_explicit(&(queue->spinning), memory_order_relaxed);
+    int allowed = atomic_load_explicit(&(queue->allowed), memory_order_relaxed);
+
+    /* Threads held back by the throttle cannot take anything */
+    if (allowed > 0) {
+        waiting -= atomic_load_explicit(&(queue->threads), memory_order_relaxed) - allowed;
+        if (waiting < 0)
+            waiting = 0;
+    }
+
+    return waiting;
 }
 
 void work_queue_destroy(WorkQueue *queue, void (*destructor)(void *)) {
 
+    int i;
+    void *item;
+
     if (queue != NULL) {
         /* Clear out and destroy the inner queue */
         pthread_mutex_lock(MUTEX(queue));
-        queue_destroy(queue->workQueue, destructor);
+        ts_queue_destroy(queue->workQueue, destructor);
+        while (dequeue_urgent(queue, &item) == 0) {
+            if (destructor != NULL)
+                destructor(item);
+        }
+        if (queue->urgent != NULL)
+            treeset_destroy(queue->urgent, NULL);
+        for (i = 0; i < queue->nShards; i++)
+            queue_destroy(queue->shards[i], destructor);
+        for (i = 0; i < queue->nLanes; i++)
+            queue_destroy(queue->lanes[i].items, destructor);
         pthread_mutex_unlock(MUTEX(queue));
+        /* Records still in the spill file are not read back, the queue is drained by now */
+        if (queue->spillFd >= 0)
+            close(queue->spillFd);
+        free(queue->writeBuffer);
+        free(queue->readBuffer);
+        free(queue->lanes);
+        free(queue->shards);
         /* Destroy mutex_t, cond_t variables and the struct itself */
         pthread_mutex_destroy(MUTEX(queue));
         pthread_cond_destroy(COND(queue));
@@ -0,0 +1,193 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2021 Cole Vikupitz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "ws_deque.h"
+
+/* Initial number of slots in the deque's array */
+#define INITIAL_SIZE 64L
+
+/*
+ * A circular array of slots. Once the deque grows, thieves may still be reading the
+ * old array, so it is kept until the deque is destroyed.
+ */
+typedef struct ring {
+    long mask;                  /* The number of slots, less one (a power of 2) */
+    struct ring *older;         /* The array replaced by this one, if any */
+    _Atomic(void *) slots[];    /* The slots */
+} Ring;
+
+/*
+ * Struct for the work-stealing deque. The items are those from 'top' up to, but not
+ * including, 'bottom'. 'top' only ever grows, while 'bottom' grows as the owner pushes
+ * and shrinks as it takes.
+ */
+struct ws_deque {
+    atomic_long top;            /* Index of the oldest item, moved by thieves (and the owner) */
+    atomic_long bottom;         /* Index past the newest item, moved by the owner */
+    _Atomic(Ring *) ring;       /* The current array */
+};
+
+/*
+ * Allocates a new array of 'size' slots, a power of 2, or returns NULL if allocation fails.
+ */
+static Ring *ring_new(long size) {
+
+    Ring *ring = (Ring *)malloc(sizeof(Ring) + size * sizeof(_Atomic(void *)));
+
+    if (ring != NULL) {
+        ring->mask = size - 1L;
+        ring->older = NULL;
+    }
+    return ring;
+}
+
+Status ws_deque_new(WsDeque **deque) {
+
+    WsDeque *temp;
+    Ring *ring;
+
+    if ((temp = (WsDeque *)malloc(sizeof(WsDeque))) == NULL)
+        return ALLOC_FAILURE;
+    if ((ring = ring_new(INITIAL_SIZE)) == NULL) {
+        free(temp);
+        return ALLOC_FAILURE;
+    }
+
+    atomic_init(&(temp->top), 0L);
+    atomic_init(&(temp->bottom), 0L);
+    atomic_init(&(temp->ring), ring);
+    *deque = temp;
+
+    return OK;
+}
+
+Status ws_deque_push(WsDeque *deque, void *item) {
+
+    long bottom = atomic_load_explicit(&(deque->bottom), memory_order_relaxed);
+    long top = atomic_load_explicit(&(deque->top), memory_order_acquire);
+    Ring *ring = atomic_load_explicit(&(deque->ring), memory_order_relaxed);
+
+    /* Full, the items are copied to an array twice the size */
+    if (bottom - top > ring->mask) {
+        Ring *bigger = ring_new(2L * (ring->mask + 1L));
+        long i;
+        if (bigger == NULL)
+            return ALLOC_FAILURE;
+        for (i = top; i < bottom; i++)
+            atomic_store_explicit(&(bigger->slots[i & bigger->mask]),
+                                  atomic_load_explicit(&(ring->slots[i & ring->mask]), memory_order_relaxed),
+                                  memory_order_relaxed);
+        bigger->older = ring;
+        atomic_store_explicit(&(deque->ring), bigger, memory_order_release);
+        ring = bigger;
+    }
+
+    atomic_store_explicit(&(ring->slots[bottom & ring->mask]), item, memory_order_relaxed);
+    /* The item must be visible before thieves can see the new bottom */
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&(deque->bottom), bottom + 1L, memory_order_relaxed);
+
+    return OK;
+}
+
+Status ws_deque_take(WsDeque *deque, void **item) {
+
+    long bottom = atomic_load_explicit(&(deque->bottom), memory_order_relaxed) - 1L;
+    Ring *ring = atomic_load_explicit(&(deque->ring), memory_order_relaxed);
+    long top;
+    Status status = OK;
+
+    /* Claims the bottom item first, then checks whether a thief got to it */
+    atomic_store_explicit(&(deque->bottom), bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&(deque->top), memory_order_relaxed);
+
+    if (top <= bottom) {
+        *item = atomic_load_explicit(&(ring->slots[bottom & ring->mask]), memory_order_relaxed);
+        if (top == bottom) {
+            /* The last item, the owner races the thieves for it */
+            if (!atomic_compare_exchange_strong_explicit(&(deque->top), &top, top + 1L,
+                                                         memory_order_seq_cst, memory_order_relaxed))
+                status = STRUCT_EMPTY;
+            atomic_store_explicit(&(deque->bottom), bottom + 1L, memory_order_relaxed);
+        }
+    } else {
+        status = STRUCT_EMPTY;
+        atomic_store_explicit(&(deque->bottom), bottom + 1L, memory_order_relaxed);
+    }
+
+    return status;
+}
+
+Status ws_deque_steal(WsDeque *deque, void **item) {
+
+    long top = atomic_load_explicit(&(deque->top), memory_order_acquire);
+    long bottom;
+    Ring *ring;
+    void *temp;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&(deque->bottom), memory_order_acquire);
+    if (top >= bottom)
+        return STRUCT_EMPTY;
+
+    ring = atomic_load_explicit(&(deque->ring), memory_order_acquire);
+    temp = atomic_load_explicit(&(ring->slots[top & ring->mask]), memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&(deque->top), &top, top + 1L,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+        return STRUCT_EMPTY;
+
+    *item = temp;
+    return OK;
+}
+
+long ws_deque_size(WsDeque *deque) {
+
+    long bottom = atomic_load_explicit(&(deque->bottom), memory_order_relaxed);
+    long top = atomic_load_explicit(&(deque->top), memory_order_relaxed);
+
+    return (bottom > top) ? (bottom - top) : 0L;
+}
+
+void ws_deque_destroy(WsDeque *deque, void (*destructor)(void *)) {
+
+    Ring *ring, *older;
+    long i, bottom;
+
+    if (deque != NULL) {
+        ring = atomic_load_explicit(&(deque->ring), memory_order_relaxed);
+        bottom = atomic_load_explicit(&(deque->bottom), memory_order_relaxed);
+        if (destructor != NULL) {
+            for (i = atomic_load_explicit(&(deque->top), memory_order_relaxed); i < bottom; i++)
+                destructor(atomic_load_explicit(&(ring->slots[i & ring->mask]), memory_order_relaxed));
+        }
+        for (; ring != NULL; ring = older) {
+            older = ring->older;
+            free(ring);
+        }
+        free(deque);
+    }
+}